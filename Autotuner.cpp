@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "Autotuner.hpp"
+#include "Engines.hpp"
+#include "MaskGenerators.hpp"
+
+namespace Autotuner {
+
+using OpenCLUtils::LaunchConfig;
+
+namespace {
+
+const std::vector<size_t> localSizes = {16, 32, 64, 128, 256};
+const std::vector<cl_uint> itemsPerWorkItem = {1, 2, 4, 8, 16};
+const std::vector<cl_uint> queueCapacities = {16, 32, 64, 128};
+
+// A calibração usa a máscara típica do benchmark: sementes esparsas em 1024².
+const unsigned int calibrationSize = 1024;
+const double calibrationDensity = 0.001;
+const unsigned int repetitions = 3;
+
+/**
+ * \brief Linha do arquivo de perfis: nome, driver, tamanho do work-group,
+ * pixels por work-item e capacidade da fila, separados por tabulação.
+*/
+struct ProfileLine {
+  std::string name;
+  std::string driver;
+  LaunchConfig config;
+};
+
+std::vector<ProfileLine> readProfiles(const std::string &path) {
+  std::vector<ProfileLine> profiles;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    ProfileLine profile;
+    std::string localSize, items, capacity;
+    if (std::getline(stream, profile.name, '\t') &&
+        std::getline(stream, profile.driver, '\t') &&
+        std::getline(stream, localSize, '\t') &&
+        std::getline(stream, items, '\t') && std::getline(stream, capacity)) {
+      // Linhas corrompidas são ignoradas, caindo na configuração padrão.
+      try {
+        profile.config.localSize = std::stoul(localSize);
+        profile.config.itemsPerWorkItem = std::stoul(items);
+        profile.config.queueCapacity = std::stoul(capacity);
+      } catch (const std::exception &) {
+        continue;
+      }
+      profiles.push_back(profile);
+    }
+  }
+  return profiles;
+}
+
+double kernelMs(const Profiler &profiler) {
+  for (const Profiler::Phase &phase : profiler.phases())
+    if (phase.name == "kernel")
+      return phase.deviceMs;
+  return std::numeric_limits<double>::infinity();
+}
+
+} // namespace
+
+std::string profilePath() {
+  if (const char *path = std::getenv("EUCLIGPU_PROFILE"))
+    return path;
+  const char *home = std::getenv("HOME");
+  return std::string(home != nullptr ? home : ".") + "/.eucligpu_profiles";
+}
+
+LaunchConfig loadProfile(const cl::Device &device) {
+  const std::string name = device.getInfo<CL_DEVICE_NAME>();
+  const std::string driver = device.getInfo<CL_DRIVER_VERSION>();
+  for (const ProfileLine &profile : readProfiles(profilePath()))
+    if (profile.name == name && profile.driver == driver)
+      return profile.config;
+  return LaunchConfig();
+}
+
+void saveProfile(const cl::Device &device, const LaunchConfig &config) {
+  const std::string path = profilePath();
+  const ProfileLine saved{device.getInfo<CL_DEVICE_NAME>(),
+                          device.getInfo<CL_DRIVER_VERSION>(), config};
+  std::vector<ProfileLine> profiles = readProfiles(path);
+  profiles.erase(std::remove_if(profiles.begin(), profiles.end(),
+                                [&saved](const ProfileLine &profile) {
+                                  return profile.name == saved.name &&
+                                         profile.driver == saved.driver;
+                                }),
+                 profiles.end());
+  profiles.push_back(saved);
+
+  std::ofstream file(path, std::ios::trunc);
+  if (!file)
+    throw std::runtime_error("Could not write the profile file " + path);
+  for (const ProfileLine &profile : profiles)
+    file << profile.name << '\t' << profile.driver << '\t'
+         << profile.config.localSize << '\t'
+         << profile.config.itemsPerWorkItem << '\t'
+         << profile.config.queueCapacity << '\n';
+}
+
+LaunchConfig autotune(const cl::Device &device, std::ostream *log) {
+  std::vector<unsigned char> mask = MaskGenerators::sparse(
+      calibrationSize, calibrationSize, calibrationDensity, 42);
+  const UCImage image =
+      constructUCImage(mask.data(), calibrationSize, calibrationSize);
+  std::vector<VoronoiDiagramMapEntry> seeded(mask.size());
+  VoronoiDiagramMap voronoi;
+  voronoi.sizeOfDiagram = seeded.size();
+  voronoi.entries = seeded.data();
+  std::vector<cl_uint4> queue;
+  initVoronoi(&image, &voronoi, &queue);
+
+  // Cada execução parte do mesmo diagrama semeado.
+  std::vector<VoronoiDiagramMapEntry> entries(seeded.size());
+  voronoi.entries = entries.data();
+
+  LaunchConfig best;
+  double bestMs = std::numeric_limits<double>::infinity();
+  for (const cl_uint capacity : queueCapacities) {
+    // A capacidade da fila é fixada na compilação, então cada uma exige um
+    // programa próprio.
+    LaunchConfig config;
+    config.queueCapacity = capacity;
+    OpenCLUtils::DeviceContext context(device, kernelSource(), config);
+    const size_t maxLocalSize =
+        cl::Kernel(context.program(), KERNELNAME)
+            .getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+
+    for (const size_t localSize : localSizes) {
+      if (localSize > maxLocalSize)
+        continue;
+      for (const cl_uint items : itemsPerWorkItem) {
+        context.config.localSize = localSize;
+        context.config.itemsPerWorkItem = items;
+
+        std::vector<double> times;
+        // A primeira execução aquece o dispositivo e não é contada.
+        for (unsigned int i = 0; i <= repetitions; i++) {
+          std::copy(seeded.begin(), seeded.end(), entries.begin());
+          Profiler profiler;
+          OpenCLUtils::executeOpenCL(context, KERNELNAME, &image, queue,
+                                     &voronoi, &profiler);
+          if (i > 0)
+            times.push_back(kernelMs(profiler));
+        }
+        std::sort(times.begin(), times.end());
+        const double median = times[times.size() / 2];
+        if (log != nullptr)
+          *log << "local " << localSize << ", items " << items << ", queue "
+               << capacity << ": " << median << " ms\n";
+        if (median < bestMs) {
+          bestMs = median;
+          best = context.config;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+} // namespace Autotuner
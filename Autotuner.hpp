@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "OpenCLUtils.hpp"
+
+/**
+ * \brief Ajuste da geometria de lançamento do kernel por dispositivo. O
+ * resultado é salvo num arquivo de perfis, indexado pelo nome do dispositivo e
+ * pela versão do driver, e carregado pelos Context e Scheduler criados com
+ * DeviceOptions::loadProfile.
+*/
+namespace Autotuner {
+
+/**
+ * \brief Caminho do arquivo de perfis: $EUCLIGPU_PROFILE, ou
+ * ~/.eucligpu_profiles quando a variável não está definida.
+*/
+std::string profilePath();
+
+/**
+ * \brief Configuração salva para o dispositivo, ou a padrão se ele nunca foi
+ * ajustado com o driver atual.
+*/
+OpenCLUtils::LaunchConfig loadProfile(const cl::Device &device);
+
+/**
+ * \brief Salva a configuração do dispositivo, substituindo a anterior.
+*/
+void saveProfile(const cl::Device &device,
+                 const OpenCLUtils::LaunchConfig &config);
+
+/**
+ * \brief Mede o kernel numa máscara de calibração com cada combinação de
+ * tamanho de work-group, pixels por work-item e capacidade da fila, retornando
+ * a mais rápida. Cada combinação medida é escrita em log, se informado.
+*/
+OpenCLUtils::LaunchConfig autotune(const cl::Device &device,
+                                   std::ostream *log = nullptr);
+
+} // namespace Autotuner
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+
+#include <unistd.h>
+
+#include "BufferPool.hpp"
+
+namespace EucliGPU {
+
+namespace {
+
+size_t pageSize() {
+  static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+} // namespace
+
+BufferPool::BufferPool(const size_t maxRetainedBytes)
+    : m_maxRetainedBytes(maxRetainedBytes) {}
+
+BufferPool::~BufferPool() {
+  for (const auto &entry : m_free)
+    std::free(entry.second);
+}
+
+void *BufferPool::acquireBytes(const size_t bytes, size_t &capacity) {
+  // aligned_alloc exige um tamanho múltiplo do alinhamento, e um bloco vazio
+  // ainda ocupa uma página, para que data() nunca seja nulo.
+  const size_t page = pageSize();
+  const size_t rounded = std::max<size_t>(1, (bytes + page - 1) / page) * page;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // O menor bloco livre que comporta o pedido. Um bloco de mais que o
+    // dobro fica para um pedido maior, em vez de prender toda a sua memória
+    // num pedido pequeno.
+    const auto found = m_free.lower_bound(rounded);
+    if (found != m_free.end() && found->first / 2 <= rounded) {
+      capacity = found->first;
+      void *block = found->second;
+      m_free.erase(found);
+      m_retainedBytes -= capacity;
+      return block;
+    }
+    m_allocations++;
+  }
+
+  void *block = std::aligned_alloc(page, rounded);
+  if (block == nullptr)
+    throw std::bad_alloc();
+  capacity = rounded;
+  return block;
+}
+
+void BufferPool::release(void *block, const size_t capacity) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (capacity > m_maxRetainedBytes) {
+    std::free(block);
+    return;
+  }
+  m_free.emplace(capacity, block);
+  m_retainedBytes += capacity;
+  evictOverLimit();
+}
+
+std::vector<cl_uint4> BufferPool::takeQueue(const size_t maxCount) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // A maior fila livre de até o dobro do pedido: a fila pode ter qualquer
+  // tamanho até maxCount, e a maior evita mais realocações.
+  const auto limit = m_queues.upper_bound(2 * maxCount * sizeof(cl_uint4));
+  if (limit == m_queues.begin())
+    return {};
+  const auto found = std::prev(limit);
+  std::vector<cl_uint4> queue = std::move(found->second);
+  m_retainedBytes -= found->first;
+  m_queues.erase(found);
+  queue.clear();
+  return queue;
+}
+
+void BufferPool::recycle(std::vector<cl_uint4> &&queue) {
+  const size_t bytes = queue.capacity() * sizeof(cl_uint4);
+  if (bytes == 0)
+    return;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (bytes > m_maxRetainedBytes)
+    return;
+  m_queues.emplace(bytes, std::move(queue));
+  m_retainedBytes += bytes;
+  evictOverLimit();
+}
+
+void BufferPool::evictOverLimit() {
+  while (m_retainedBytes > m_maxRetainedBytes) {
+    // O maior entre o maior bloco e a maior fila.
+    const bool evictQueue =
+        m_free.empty() ||
+        (!m_queues.empty() &&
+         std::prev(m_queues.end())->first > std::prev(m_free.end())->first);
+    if (evictQueue) {
+      const auto largest = std::prev(m_queues.end());
+      m_retainedBytes -= largest->first;
+      m_queues.erase(largest);
+    } else {
+      const auto largest = std::prev(m_free.end());
+      m_retainedBytes -= largest->first;
+      std::free(largest->second);
+      m_free.erase(largest);
+    }
+  }
+}
+
+void BufferPool::trim() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto &entry : m_free)
+    std::free(entry.second);
+  m_free.clear();
+  m_retainedBytes = 0;
+  m_queues.clear();
+}
+
+size_t BufferPool::allocations() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_allocations;
+}
+
+size_t BufferPool::retainedBytes() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_retainedBytes;
+}
+
+} // namespace EucliGPU
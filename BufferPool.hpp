@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "ImageUtils.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Buffers de trabalho do host reaproveitados entre imagens: diagramas,
+ * máscaras empacotadas e filas iniciais. Um bloco devolvido volta para o pool
+ * já mapeado, e a próxima imagem de tamanho igual ou menor o reutiliza sem
+ * alocação nem faltas de página. Pode ser usado por várias threads ao mesmo tempo. Os blocos livres são
+ * liberados por trim, na destruição ou quando passam do limite de bytes
+ * guardados.
+*/
+class BufferPool {
+public:
+  /**
+   * \brief Bloco de count elementos emprestado do pool e devolvido a ele na
+   * destruição. Os elementos não são inicializados.
+  */
+  template <typename T> class Lease {
+  public:
+    Lease(Lease &&other) noexcept
+        : m_pool(other.m_pool), m_block(other.m_block),
+          m_capacity(other.m_capacity), m_count(other.m_count) {
+      other.m_pool = nullptr;
+    }
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+    Lease &operator=(Lease &&) = delete;
+
+    ~Lease() {
+      if (m_pool != nullptr)
+        m_pool->release(m_block, m_capacity);
+    }
+
+    T *data() const { return static_cast<T *>(m_block); }
+    size_t size() const { return m_count; }
+
+  private:
+    friend class BufferPool;
+    Lease(BufferPool *pool, void *block, const size_t capacity,
+          const size_t count)
+        : m_pool(pool), m_block(block), m_capacity(capacity), m_count(count) {}
+
+    BufferPool *m_pool;
+    void *m_block;
+    size_t m_capacity;
+    size_t m_count;
+  };
+
+  /**
+   * \brief Fila de no máximo maxCount pixels emprestada do pool, vazia mas
+   * com a capacidade de uma fila devolvida antes, para que o push_back não
+   * realoque a cada imagem. Como nos blocos, uma fila de mais que o dobro de
+   * maxCount fica para uma imagem maior.
+  */
+  class Queue {
+  public:
+    Queue(BufferPool &pool, const size_t maxCount)
+        : m_pool(pool), m_queue(pool.takeQueue(maxCount)) {}
+    Queue(const Queue &) = delete;
+    Queue &operator=(const Queue &) = delete;
+    ~Queue() { m_pool.recycle(std::move(m_queue)); }
+
+    std::vector<cl_uint4> &operator*() { return m_queue; }
+    std::vector<cl_uint4> *operator->() { return &m_queue; }
+
+  private:
+    BufferPool &m_pool;
+    std::vector<cl_uint4> m_queue;
+  };
+
+  // Limite padrão dos bytes em blocos livres guardados pelo pool.
+  static constexpr size_t defaultRetainedBytes = size_t(1) << 30;
+
+  /**
+   * \brief Um bloco ou fila devolvido que faria os livres passarem de
+   * maxRetainedBytes libera antes os maiores deles, e um maior que o limite
+   * não é guardado.
+  */
+  explicit BufferPool(const size_t maxRetainedBytes = defaultRetainedBytes);
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+  ~BufferPool();
+
+  template <typename T> Lease<T> acquire(const size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Pooled buffers hold raw memory");
+    size_t capacity = 0;
+    void *block = acquireBytes(count * sizeof(T), capacity);
+    return Lease<T>(this, block, capacity, count);
+  }
+
+  /**
+   * \brief Libera os blocos e as filas livres. Os emprestados continuam
+   * válidos e voltam ao pool normalmente.
+  */
+  void trim();
+
+  /**
+   * \brief Blocos alocados do sistema desde a criação; num lote de imagens do
+   * mesmo tamanho, para de crescer depois da primeira.
+  */
+  size_t allocations() const;
+
+  /**
+   * \brief Bytes dos blocos e das filas livres guardados para os próximos
+   * pedidos.
+  */
+  size_t retainedBytes() const;
+
+private:
+  void *acquireBytes(const size_t bytes, size_t &capacity);
+  void release(void *block, const size_t capacity);
+  std::vector<cl_uint4> takeQueue(const size_t maxCount);
+  void recycle(std::vector<cl_uint4> &&queue);
+  // Libera os maiores livres até que caibam no limite. Exige m_mutex.
+  void evictOverLimit();
+
+  mutable std::mutex m_mutex;
+  // Blocos livres pela capacidade, em bytes múltiplos da página.
+  std::multimap<size_t, void *> m_free;
+  const size_t m_maxRetainedBytes;
+  size_t m_retainedBytes = 0;
+  // Filas livres pela capacidade, em bytes.
+  std::multimap<size_t, std::vector<cl_uint4>> m_queues;
+  size_t m_allocations = 0;
+};
+
+} // namespace EucliGPU
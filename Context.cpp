@@ -0,0 +1,41 @@
+#include "Autotuner.hpp"
+#include "Context.hpp"
+#include "Engines.hpp"
+
+namespace EucliGPU {
+
+Context::Context(const unsigned int deviceIndex,
+                 const DeviceOptions &deviceOptions) {
+  const cl::Device device = OpenCLUtils::getDevice(deviceIndex);
+  m_deviceContext.reset(new OpenCLUtils::DeviceContext(
+      device, kernelSource(),
+      deviceOptions.loadProfile ? Autotuner::loadProfile(device)
+                                : OpenCLUtils::LaunchConfig()));
+  if (deviceOptions.log != nullptr)
+    *deviceOptions.log << "Using device: " << m_deviceContext->name() << "\n";
+}
+
+Context::~Context() = default;
+
+std::string Context::deviceName() const { return m_deviceContext->name(); }
+
+void Context::computeEDT(const uint8_t *mask, const unsigned int width,
+                         const unsigned int height, const Options &options,
+                         float *output) {
+  Options contextOptions = options;
+  contextOptions.context = this;
+  EucliGPU::computeEDT(mask, width, height, contextOptions, output);
+}
+
+void Context::computeEDTBatch(const std::vector<BatchItem> &items,
+                              const Options &options) {
+  Options contextOptions = options;
+  contextOptions.context = this;
+  EucliGPU::computeEDTBatch(items, contextOptions);
+}
+
+OpenCLUtils::DeviceContext &Context::deviceContext() {
+  return *m_deviceContext;
+}
+
+} // namespace EucliGPU
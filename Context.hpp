@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "DistanceTransform.hpp"
+
+namespace OpenCLUtils {
+class DeviceContext;
+}
+
+namespace EucliGPU {
+
+/**
+ * \brief Como um Context ou o Scheduler preparam os dispositivos. Por padrão a
+ * biblioteca não lê nenhum arquivo nem escreve nada.
+*/
+struct DeviceOptions {
+  // Usa a geometria de lançamento salva pelo autotuner no arquivo de perfis
+  // (Autotuner::profilePath), em vez da padrão.
+  bool loadProfile = false;
+  // Quando não nulo, recebe os dispositivos usados e os descartados.
+  std::ostream *log = nullptr;
+};
+
+/**
+ * \brief Dispositivo OpenCL pronto para as transformadas, com o contexto, a
+ * fila e as variantes do kernel compiladas no primeiro uso. Criar um é caro, e
+ * ele deve ser reaproveitado entre chamadas: com Options::context apontando
+ * para ele, todas as funções da biblioteca o usam em vez de criar e compilar
+ * um a cada chamada. Não deve ser usado por duas threads ao mesmo tempo.
+*/
+class Context {
+public:
+  /**
+   * \brief Usa o dispositivo deviceIndex, numerado em sequência por todas as
+   * plataformas.
+  */
+  explicit Context(const unsigned int deviceIndex = 0,
+                   const DeviceOptions &deviceOptions = DeviceOptions());
+  Context(const Context &) = delete;
+  Context &operator=(const Context &) = delete;
+  ~Context();
+
+  std::string deviceName() const;
+
+  /**
+   * \brief computeEDT e computeEDTBatch neste dispositivo, qualquer que seja
+   * options.context.
+  */
+  void computeEDT(const uint8_t *mask, const unsigned int width,
+                  const unsigned int height, const Options &options,
+                  float *output);
+  void computeEDTBatch(const std::vector<BatchItem> &items,
+                       const Options &options);
+
+  /**
+   * \brief Para as implementações da biblioteca.
+  */
+  OpenCLUtils::DeviceContext &deviceContext();
+
+private:
+  std::unique_ptr<OpenCLUtils::DeviceContext> m_deviceContext;
+};
+
+} // namespace EucliGPU
@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Daemon.hpp"
+#include "Scheduler.hpp"
+
+namespace EucliGPU {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Limites que impedem um cabeçalho inválido de provocar uma alocação enorme.
+const size_t maxRequestPixels = 256 * 1024 * 1024;
+const size_t maxHeaderLength = 4096;
+// Quantas latências, as mais recentes, entram nos percentis.
+const size_t latencyWindow = 10000;
+// Intervalo em que o laço de conexões confere se stop() foi chamado.
+const int pollIntervalMs = 200;
+// Sem requisições por esse tempo, os buffers do host guardados são liberados.
+const std::chrono::seconds idleTrimDelay(30);
+
+std::string systemError(const std::string &call) {
+  return call + ": " + std::strerror(errno);
+}
+
+/**
+ * \brief Leitura com buffer e escrita completa sobre o socket de uma conexão.
+*/
+class Connection {
+public:
+  explicit Connection(const int fd) : m_fd(fd) {}
+
+  /**
+   * \brief Lê uma linha sem o '\n'. Retorna falso se a conexão terminar antes.
+  */
+  bool readLine(std::string &line) {
+    for (;;) {
+      const size_t newline = m_buffer.find('\n', m_start);
+      if (newline != std::string::npos) {
+        line = m_buffer.substr(m_start, newline - m_start);
+        m_start = newline + 1;
+        return true;
+      }
+      if (m_buffer.size() - m_start > maxHeaderLength)
+        throw std::runtime_error("Request header too long");
+      if (!fill())
+        return false;
+    }
+  }
+
+  bool readExact(void *data, size_t size) {
+    char *output = static_cast<char *>(data);
+    const size_t buffered = std::min(size, m_buffer.size() - m_start);
+    std::copy(m_buffer.begin() + m_start, m_buffer.begin() + m_start + buffered,
+              output);
+    m_start += buffered;
+    output += buffered;
+    size -= buffered;
+    while (size > 0) {
+      const ssize_t received = ::recv(m_fd, output, size, 0);
+      if (received < 0 && errno == EINTR)
+        continue;
+      if (received <= 0)
+        return false;
+      output += received;
+      size -= received;
+    }
+    return true;
+  }
+
+  void write(const void *data, size_t size) {
+    const char *input = static_cast<const char *>(data);
+    while (size > 0) {
+      // Um cliente que fechou a conexão não deve encerrar o processo com SIGPIPE.
+      const ssize_t sent = ::send(m_fd, input, size, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+        continue;
+      if (sent < 0)
+        throw std::runtime_error(systemError("send"));
+      input += sent;
+      size -= sent;
+    }
+  }
+
+  void write(const std::string &text) { write(text.data(), text.size()); }
+
+private:
+  bool fill() {
+    m_buffer.erase(0, m_start);
+    m_start = 0;
+    char chunk[4096];
+    for (;;) {
+      const ssize_t received = ::recv(m_fd, chunk, sizeof(chunk), 0);
+      if (received < 0 && errno == EINTR)
+        continue;
+      if (received <= 0)
+        return false;
+      m_buffer.append(chunk, received);
+      return true;
+    }
+  }
+
+  const int m_fd;
+  std::string m_buffer;
+  size_t m_start = 0;
+};
+
+/**
+ * \brief Uma máscara aguardando o dispositivo, com a saída preenchida pela
+ * thread de execução.
+*/
+struct Request {
+  Metric metric = Metric::Euclidean;
+  unsigned int width = 0;
+  unsigned int height = 0;
+  std::vector<uint8_t> mask;
+  std::vector<float> distances;
+  std::promise<void> done;
+};
+
+double percentile(const std::vector<double> &sorted, const double p) {
+  if (sorted.empty())
+    return 0;
+  const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+} // namespace
+
+struct Daemon::Impl {
+  struct Client {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> finished{false};
+  };
+
+  std::string socketPath;
+  MaskReader reader;
+  DistanceWriter writer;
+  Scheduler scheduler;
+  int listener = -1;
+  // Atômico para que stop() possa ser chamado de um tratador de sinal.
+  std::atomic<bool> stopping{false};
+
+  std::mutex mutex;
+  std::condition_variable pendingChanged;
+  // Compartilhadas com a thread de execução, que ainda usa a promessa depois
+  // de acordar a conexão que espera por ela.
+  std::vector<std::shared_ptr<Request>> pending;
+
+  mutable std::mutex latencyMutex;
+  std::deque<double> latencies;
+  size_t served = 0;
+
+  std::list<std::unique_ptr<Client>> clients;
+
+  explicit Impl(const DeviceOptions &deviceOptions) : scheduler(deviceOptions) {}
+
+  /**
+   * \brief Thread de execução: tudo que chegou enquanto o lote anterior
+   * executava forma o próximo lote, uma execução do Scheduler por métrica.
+   * Termina com stop() quando não há mais nada pendente.
+  */
+  void execute() {
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto ready = [this]() { return !pending.empty() || stopping; };
+    for (;;) {
+      if (!pendingChanged.wait_for(lock, idleTrimDelay, ready)) {
+        scheduler.trimBuffers();
+        pendingChanged.wait(lock, ready);
+      }
+      if (pending.empty())
+        return;
+      std::vector<std::shared_ptr<Request>> batch;
+      batch.swap(pending);
+      lock.unlock();
+
+      for (const Metric metric : allMetrics) {
+        std::vector<std::shared_ptr<Request>> group;
+        std::vector<BatchItem> items;
+        for (const std::shared_ptr<Request> &request : batch)
+          if (request->metric == metric) {
+            group.push_back(request);
+            items.push_back(BatchItem{request->mask.data(), request->width,
+                                      request->height,
+                                      request->distances.data()});
+          }
+        if (group.empty())
+          continue;
+        try {
+          scheduler.run(items, metric);
+          for (const std::shared_ptr<Request> &request : group)
+            request->done.set_value();
+        } catch (...) {
+          for (const std::shared_ptr<Request> &request : group)
+            request->done.set_exception(std::current_exception());
+        }
+      }
+      lock.lock();
+    }
+  }
+
+  /**
+   * \brief Entrega a requisição à thread de execução e espera o resultado,
+   * registrando a latência.
+  */
+  void submit(const std::shared_ptr<Request> &request) {
+    const Clock::time_point received = Clock::now();
+    request->distances.resize(request->mask.size());
+    std::future<void> done = request->done.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping)
+        throw std::runtime_error("The daemon is stopping");
+      pending.push_back(request);
+    }
+    pendingChanged.notify_one();
+    done.get();
+
+    const std::chrono::duration<double, std::milli> elapsed =
+        Clock::now() - received;
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    latencies.push_back(elapsed.count());
+    if (latencies.size() > latencyWindow)
+      latencies.pop_front();
+    served++;
+  }
+
+  static Metric readMetric(std::istream &tokens) {
+    std::string name;
+    return tokens >> name ? parseMetric(name) : Metric::Euclidean;
+  }
+
+  static void checkSize(const unsigned int width, const unsigned int height) {
+    if (width == 0 || height == 0 ||
+        static_cast<size_t>(width) * height > maxRequestPixels)
+      throw std::runtime_error("Invalid mask size");
+  }
+
+  std::string handle(const std::string &line, Connection &connection) {
+    std::istringstream tokens(line);
+    std::string command;
+    tokens >> command;
+    std::ostringstream reply;
+
+    if (command == "EDT") {
+      std::shared_ptr<Request> request(new Request());
+      if (!(tokens >> request->width >> request->height))
+        throw std::runtime_error("Usage: EDT <width> <height> [metric]");
+      request->metric = readMetric(tokens);
+      checkSize(request->width, request->height);
+      request->mask.resize(static_cast<size_t>(request->width) *
+                           request->height);
+      if (!connection.readExact(request->mask.data(), request->mask.size()))
+        throw std::runtime_error("Truncated mask");
+      submit(request);
+      reply << "OK " << request->width << " " << request->height << "\n";
+      connection.write(reply.str());
+      connection.write(request->distances.data(),
+                       sizeof(float) * request->distances.size());
+      return "";
+    }
+
+    if (command == "FILE") {
+      std::string input, output;
+      if (!(tokens >> input >> output))
+        throw std::runtime_error("Usage: FILE <input> <output> [metric]");
+      if (!reader || !writer)
+        throw std::runtime_error("File requests are not supported");
+      std::shared_ptr<Request> request(new Request());
+      request->metric = readMetric(tokens);
+      request->mask = reader(input, request->width, request->height);
+      checkSize(request->width, request->height);
+      submit(request);
+      writer(output, request->distances.data(), request->width, request->height,
+             request->metric);
+      reply << "OK " << request->width << " " << request->height << "\n";
+      return reply.str();
+    }
+
+    if (command == "STATS") {
+      const LatencyStats stats = latencyStats();
+      reply << std::fixed << std::setprecision(3) << "OK " << stats.count << " "
+            << stats.p50 << " " << stats.p95 << " " << stats.p99 << "\n";
+      return reply.str();
+    }
+
+    throw std::runtime_error("Unknown request " + command);
+  }
+
+  /**
+   * \brief Atende as requisições de uma conexão até o cliente fechá-la. Depois
+   * de um erro a conexão é encerrada, pois o restante de uma máscara não lida
+   * seria interpretado como a próxima requisição.
+  */
+  void serve(Client *client) {
+    Connection connection(client->fd);
+    std::string line;
+    try {
+      while (connection.readLine(line)) {
+        try {
+          connection.write(handle(line, connection));
+        } catch (const std::exception &e) {
+          std::string message = e.what();
+          std::replace(message.begin(), message.end(), '\n', ' ');
+          connection.write("ERR " + message + "\n");
+          break;
+        }
+      }
+    } catch (const std::exception &) {
+      // O cliente fechou a conexão no meio de uma resposta.
+    }
+    client->finished = true;
+  }
+
+  /**
+   * \brief Libera as conexões já encerradas pelos clientes.
+  */
+  void reapClients() {
+    for (auto client = clients.begin(); client != clients.end();) {
+      if (!(*client)->finished) {
+        ++client;
+        continue;
+      }
+      (*client)->thread.join();
+      ::close((*client)->fd);
+      client = clients.erase(client);
+    }
+  }
+
+  LatencyStats latencyStats() const {
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    std::vector<double> sorted(latencies.begin(), latencies.end());
+    std::sort(sorted.begin(), sorted.end());
+    return LatencyStats{served, percentile(sorted, 0.5),
+                        percentile(sorted, 0.95), percentile(sorted, 0.99)};
+  }
+};
+
+Daemon::Daemon(const std::string &socketPath, MaskReader reader,
+               DistanceWriter writer, const DeviceOptions &deviceOptions)
+    : m_impl(new Impl(deviceOptions)) {
+  Impl &impl = *m_impl;
+  impl.socketPath = socketPath;
+  impl.reader = reader;
+  impl.writer = writer;
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Invalid socket path " + socketPath);
+  std::strcpy(address.sun_path, socketPath.c_str());
+
+  impl.listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (impl.listener < 0)
+    throw std::runtime_error(systemError("socket"));
+  ::unlink(socketPath.c_str());
+  if (::bind(impl.listener, reinterpret_cast<const sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+      ::listen(impl.listener, SOMAXCONN) != 0) {
+    const std::string error = systemError("bind " + socketPath);
+    ::close(impl.listener);
+    throw std::runtime_error(error);
+  }
+}
+
+Daemon::~Daemon() {
+  ::close(m_impl->listener);
+  ::unlink(m_impl->socketPath.c_str());
+}
+
+void Daemon::run() {
+  Impl &impl = *m_impl;
+  std::thread executor(&Impl::execute, &impl);
+
+  while (!impl.stopping) {
+    pollfd listener{impl.listener, POLLIN, 0};
+    const int ready = ::poll(&listener, 1, pollIntervalMs);
+    impl.reapClients();
+    if (ready <= 0)
+      continue;
+    const int fd = ::accept(impl.listener, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    impl.clients.emplace_back(new Impl::Client());
+    Impl::Client *client = impl.clients.back().get();
+    client->fd = fd;
+    client->thread = std::thread(&Impl::serve, &impl, client);
+  }
+
+  // stop() não pode notificar a partir de um sinal; a thread de execução é
+  // acordada aqui e termina o que estiver pendente.
+  {
+    std::lock_guard<std::mutex> lock(impl.mutex);
+  }
+  impl.pendingChanged.notify_all();
+  for (const std::unique_ptr<Impl::Client> &client : impl.clients)
+    ::shutdown(client->fd, SHUT_RDWR);
+  for (const std::unique_ptr<Impl::Client> &client : impl.clients) {
+    client->thread.join();
+    ::close(client->fd);
+  }
+  impl.clients.clear();
+  executor.join();
+}
+
+void Daemon::stop() { m_impl->stopping = true; }
+
+LatencyStats Daemon::latencies() const { return m_impl->latencyStats(); }
+
+} // namespace EucliGPU
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Context.hpp"
+#include "DistanceTransform.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Percentis das latências das requisições atendidas, em milissegundos,
+ * do fim da leitura da requisição ao início da resposta.
+*/
+struct LatencyStats {
+  size_t count;
+  double p50;
+  double p95;
+  double p99;
+};
+
+/**
+ * \brief Servidor local que mantém o Scheduler, com os kernels já compilados,
+ * entre requisições recebidas por um socket Unix. Cada conexão envia
+ * requisições em sequência, cada uma com uma linha de cabeçalho:
+ *   EDT <largura> <altura> [métrica], seguida dos bytes da máscara, responde
+ *     OK <largura> <altura> seguida das distâncias em float32;
+ *   FILE <entrada> <saída> [métrica], responde OK <largura> <altura>;
+ *   STATS, responde OK <total> <p50> <p95> <p99>.
+ * Um erro responde ERR <mensagem>. As requisições que chegam enquanto o
+ * dispositivo está ocupado são agrupadas por métrica e executadas juntas.
+*/
+class Daemon {
+public:
+  /**
+   * \brief Lê a máscara de um arquivo, preenchendo as dimensões.
+  */
+  using MaskReader = std::function<std::vector<uint8_t>(
+      const std::string &path, unsigned int &width, unsigned int &height)>;
+  /**
+   * \brief Grava as distâncias de uma requisição FILE.
+  */
+  using DistanceWriter = std::function<void(
+      const std::string &path, const float *distances,
+      const unsigned int width, const unsigned int height,
+      const Metric metric)>;
+
+  /**
+   * \brief Compila os kernels em todos os dispositivos e escuta em socketPath,
+   * substituindo um socket antigo. Sem reader e writer, as requisições FILE
+   * são recusadas, pois a biblioteca não lê nem grava arquivos.
+   * deviceOptions prepara os dispositivos do Scheduler.
+  */
+  Daemon(const std::string &socketPath, MaskReader reader = nullptr,
+         DistanceWriter writer = nullptr,
+         const DeviceOptions &deviceOptions = DeviceOptions());
+  ~Daemon();
+
+  /**
+   * \brief Atende conexões até stop(), que pode ser chamado de outra thread ou
+   * de um tratador de sinal.
+  */
+  void run();
+  void stop();
+
+  LatencyStats latencies() const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace EucliGPU
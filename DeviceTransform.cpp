@@ -0,0 +1,153 @@
+#include <stdexcept>
+
+#include "Context.hpp"
+#include "DeviceTransform.hpp"
+#include "Engines.hpp"
+#include "Metrics.hpp"
+
+namespace EucliGPU {
+
+DeviceTransform::DeviceTransform(const unsigned int width,
+                                 const unsigned int height,
+                                 const Options &options,
+                                 const std::string &defines)
+    : attrs{{width, height}},
+      m_ownedContext(options.context != nullptr
+                         ? nullptr
+                         : new OpenCLUtils::DeviceContext(
+                               OpenCLUtils::getDevice(0), kernelSource())),
+      deviceContext(options.context != nullptr
+                        ? options.context->deviceContext()
+                        : *m_ownedContext),
+      program(deviceContext.program(Metrics::kernelDefines(options.metric) +
+                                    (defines.empty() ? "" : " " + defines))),
+      voronoi(deviceContext.context, CL_MEM_READ_WRITE,
+              sizeof(VoronoiDiagramMapEntry) * size(), nullptr),
+      m_profiler(options.profiler), m_metric(options.metric),
+      m_allObject(deviceContext.context, CL_MEM_READ_ONLY, size(), nullptr),
+      // Um pixel entra no máximo uma vez em cada fronteira.
+      m_frontierBuffers(deviceContext, size(), size()) {
+  const cl::Context &context = deviceContext.context;
+  std::vector<cl_uint4> imageTable = {{{0, width, height, 0}}};
+  m_imageTable =
+      cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                 sizeof(cl_uint4) * imageTable.size(), imageTable.data());
+  check(deviceContext.queue.enqueueFillBuffer(m_allObject, cl_uchar(255), 0,
+                                              size()));
+
+  m_updateSeeds = cl::Kernel(program, "updateSeeds");
+  m_updateSeeds.setArg(1, m_allObject);
+  m_updateSeeds.setArg(2, attrs);
+  m_updateSeeds.setArg(3, voronoi);
+  m_collectFrontier = cl::Kernel(program, "collectFrontier");
+  m_collectFrontier.setArg(1, m_allObject);
+  m_collectFrontier.setArg(2, attrs);
+  m_collectFrontier.setArg(3, voronoi);
+  m_propagate = cl::Kernel(program, KERNELNAME);
+  m_propagate.setArg(1, m_imageTable);
+  m_propagate.setArg(5, voronoi);
+#ifdef EDT_STATS
+  m_stats = cl::Buffer(context, CL_MEM_READ_WRITE,
+                       sizeof(cl_uint) * OpenCLUtils::STAT_COUNT, nullptr);
+  check(deviceContext.queue.enqueueFillBuffer(
+      m_stats, cl_uint(0), 0, sizeof(cl_uint) * OpenCLUtils::STAT_COUNT));
+  m_propagate.setArg(11, m_stats);
+#endif
+}
+
+void DeviceTransform::check(const cl_int errorCode) const {
+  if (errorCode != CL_SUCCESS)
+    throw std::runtime_error(OpenCLUtils::getErrorString(errorCode));
+}
+
+cl::Buffer DeviceTransform::upload(const uint8_t *mask) {
+  return upload(mask, size());
+}
+
+cl::Buffer DeviceTransform::upload(const void *data, const size_t bytes) {
+  Profiler::ScopedPhase phase(m_profiler, "upload");
+  cl::Buffer buffer(deviceContext.context, CL_MEM_READ_WRITE, bytes, nullptr);
+  m_uploadEvents.emplace_back();
+  check(deviceContext.queue.enqueueWriteBuffer(buffer, CL_FALSE, 0, bytes,
+                                               data, nullptr,
+                                               &m_uploadEvents.back()));
+  return buffer;
+}
+
+cl_uint DeviceTransform::propagate(const cl::Buffer &mask, const float band) {
+  // Todo pixel começa inválido, e os fundos da máscara viram sementes.
+  check(deviceContext.queue.enqueueFillBuffer(
+      voronoi, cl_uchar(255), 0, sizeof(VoronoiDiagramMapEntry) * size()));
+  m_updateSeeds.setArg(0, mask);
+  runPerPixel(m_updateSeeds);
+
+  m_collectFrontier.setArg(0, mask);
+  const cl_uint frontierSize = collectFrontier(m_collectFrontier, 4);
+  return propagateFrontier(mask, band, frontierSize);
+}
+
+cl_uint DeviceTransform::collectFrontier(cl::Kernel &kernel,
+                                         const cl_uint frontierArg) {
+  Profiler::ScopedPhase phase(m_profiler, "kernel");
+  const cl::CommandQueue &queue = deviceContext.queue;
+  const cl_uint zero = 0;
+  check(queue.enqueueWriteBuffer(m_frontierBuffers.size, CL_FALSE, 0,
+                                 sizeof(cl_uint), &zero));
+  kernel.setArg(frontierArg,
+                m_frontierBuffers.frontiers[m_frontierBuffers.current]);
+  kernel.setArg(frontierArg + 1, m_frontierBuffers.size);
+  runPerPixel(kernel);
+  cl_uint frontierSize = 0;
+  check(queue.enqueueReadBuffer(m_frontierBuffers.size, CL_TRUE, 0,
+                                sizeof(cl_uint), &frontierSize));
+  return frontierSize;
+}
+
+cl_uint DeviceTransform::propagateFrontier(const cl::Buffer &images,
+                                           const float band,
+                                           const cl_uint frontierSize) {
+  Profiler::ScopedPhase phase(m_profiler, "kernel");
+  m_propagate.setArg(0, images);
+  m_propagate.setArg(10, Metrics::bandLimit(m_metric, band));
+  const cl_uint rounds = OpenCLUtils::propagateRounds(
+      deviceContext, m_propagate, m_frontierBuffers, frontierSize,
+      &m_kernelEvents);
+  m_rounds += rounds;
+  return rounds;
+}
+
+void DeviceTransform::runPerPixel(const cl::Kernel &kernel) {
+  m_kernelEvents.emplace_back();
+  check(deviceContext.queue.enqueueNDRangeKernel(
+      kernel, cl::NullRange, cl::NDRange(size()), cl::NullRange, nullptr,
+      &m_kernelEvents.back()));
+}
+
+void DeviceTransform::readback(const cl::Buffer &buffer, const size_t bytes,
+                               void *output) {
+  Profiler::ScopedPhase phase(m_profiler, "readback");
+  m_readbackEvents.emplace_back();
+  check(deviceContext.queue.enqueueReadBuffer(buffer, CL_TRUE, 0, bytes,
+                                              output, nullptr,
+                                              &m_readbackEvents.back()));
+}
+
+void DeviceTransform::report() {
+#ifdef EDT_STATS
+  std::vector<cl_uint> stats(OpenCLUtils::STAT_COUNT);
+  check(deviceContext.queue.enqueueReadBuffer(
+      m_stats, CL_TRUE, 0, sizeof(cl_uint) * stats.size(), stats.data()));
+  OpenCLUtils::printPropagationStats(stats, m_rounds);
+#endif
+
+  if (m_profiler == nullptr)
+    return;
+  for (const cl::Event &event : m_uploadEvents)
+    m_profiler->addDeviceTime("upload", OpenCLUtils::getEventMs(event));
+  for (const cl::Event &event : m_kernelEvents)
+    m_profiler->addDeviceTime("kernel", OpenCLUtils::getEventMs(event));
+  for (const cl::Event &event : m_readbackEvents)
+    m_profiler->addDeviceTime("readback", OpenCLUtils::getEventMs(event));
+}
+
+} // namespace EucliGPU
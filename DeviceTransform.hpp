@@ -0,0 +1,109 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DistanceTransform.hpp"
+#include "OpenCLUtils.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Transformada de máscaras que ficam no dispositivo, com o diagrama de
+ * Voronoi mantido lá para os kernels que o consomem, como a morfologia e o
+ * esqueleto. O diagrama é semeado a partir da máscara pelos kernels do vídeo,
+ * sem fila no host, e só o que o chamador pedir é lido de volta.
+ * Usa o dispositivo de Options::context ou, sem ele, um contexto criado só
+ * para ela, no primeiro dispositivo.
+*/
+class DeviceTransform {
+public:
+  /**
+   * \brief defines são opções -D da compilação do kernel, além da métrica.
+  */
+  DeviceTransform(const unsigned int width, const unsigned int height,
+                  const Options &options, const std::string &defines = "");
+
+  size_t size() const {
+    return static_cast<size_t>(attrs.v2[0]) * attrs.v2[1];
+  }
+
+  /**
+   * \brief Envia uma máscara de size() bytes para um buffer novo.
+  */
+  cl::Buffer upload(const uint8_t *mask);
+
+  /**
+   * \brief Envia bytes de data para um buffer novo.
+  */
+  cl::Buffer upload(const void *data, const size_t bytes);
+
+  /**
+   * \brief Preenche voronoi com a transformada de mask, com a faixa band na
+   * escala de saída da métrica. Retorna o número de rodadas.
+  */
+  cl_uint propagate(const cl::Buffer &mask, const float band);
+
+  /**
+   * \brief Lança kernel com um work-item por pixel para coletar a fronteira
+   * inicial, passando a ele a fronteira e o seu tamanho nos argumentos
+   * frontierArg e frontierArg + 1. Retorna o tamanho da fronteira coletada.
+  */
+  cl_uint collectFrontier(cl::Kernel &kernel, const cl_uint frontierArg);
+
+  /**
+   * \brief Propaga a partir da fronteira coletada, sobre o diagrama que já
+   * está em voronoi. images é o primeiro argumento do kernel de propagação.
+   * Retorna o número de rodadas.
+  */
+  cl_uint propagateFrontier(const cl::Buffer &images, const float band,
+                            const cl_uint frontierSize);
+
+  /**
+   * \brief Lança um kernel com um work-item por pixel.
+  */
+  void runPerPixel(const cl::Kernel &kernel);
+
+  /**
+   * \brief Lê bytes de buffer em output, esperando o fim de todos os kernels.
+  */
+  void readback(const cl::Buffer &buffer, const size_t bytes, void *output);
+
+  /**
+   * \brief Entrega ao profiler os tempos de dispositivo das transferências e
+   * dos kernels e, com EDT_STATS, imprime os contadores da propagação.
+  */
+  void report();
+
+  cl_uint2 attrs;
+
+private:
+  // Só existe sem Options::context; deviceContext é um ou outro.
+  std::unique_ptr<OpenCLUtils::DeviceContext> m_ownedContext;
+
+public:
+  OpenCLUtils::DeviceContext &deviceContext;
+  // Programa compilado para a métrica de Options.
+  const cl::Program &program;
+  cl::Buffer voronoi;
+
+private:
+  void check(const cl_int errorCode) const;
+
+  Profiler *m_profiler;
+  const Metric m_metric;
+  // Toda de objeto, faz o papel da máscara anterior do vídeo, para que todo
+  // fundo seja novo.
+  cl::Buffer m_allObject;
+  cl::Buffer m_imageTable;
+  OpenCLUtils::FrontierBuffers m_frontierBuffers;
+  cl::Kernel m_updateSeeds, m_collectFrontier, m_propagate;
+  std::vector<cl::Event> m_uploadEvents, m_kernelEvents, m_readbackEvents;
+  cl_uint m_rounds = 0;
+#ifdef EDT_STATS
+  cl::Buffer m_stats;
+#endif
+};
+
+} // namespace EucliGPU
@@ -0,0 +1,75 @@
+#include <stdexcept>
+
+#include "Context.hpp"
+#include "DistanceTransform.hpp"
+#include "Engines.hpp"
+
+namespace EucliGPU {
+
+std::string engineName(const Engine engine) {
+  switch (engine) {
+  case Engine::OpenCL: return "opencl";
+  case Engine::CPU: return "cpu";
+  case Engine::Exact: return "exact";
+  }
+  return "unknown";
+}
+
+Engine parseEngine(const std::string &name) {
+  for (const Engine engine : allEngines)
+    if (engineName(engine) == name)
+      return engine;
+  throw std::runtime_error("Unknown engine " + name +
+                           ", expected one of opencl, cpu or exact");
+}
+
+std::string metricName(const Metric metric) {
+  switch (metric) {
+  case Metric::Euclidean: return "euclidean";
+  case Metric::Squared: return "squared";
+  case Metric::CityBlock: return "cityblock";
+  case Metric::Chessboard: return "chessboard";
+  case Metric::Chamfer34: return "chamfer34";
+  case Metric::Chamfer5711: return "chamfer5711";
+  }
+  return "unknown";
+}
+
+Metric parseMetric(const std::string &name) {
+  for (const Metric metric : allMetrics)
+    if (metricName(metric) == name)
+      return metric;
+  throw std::runtime_error("Unknown metric " + name +
+                           ", expected one of euclidean, squared, cityblock, "
+                           "chessboard, chamfer34 or chamfer5711");
+}
+
+void computeEDT(const uint8_t *mask, const unsigned int width,
+                const unsigned int height, const Options &options,
+                float *output) {
+  if (mask == nullptr || output == nullptr)
+    throw std::runtime_error("The mask and output buffers must not be null");
+  if (width == 0 || height == 0)
+    return;
+
+  // A imagem só é lida, o const_cast apenas adapta ao tipo do UCImage.
+  const UCImage image =
+      constructUCImage(const_cast<uint8_t *>(mask), height, width);
+  computeDistanceTransform(options, &image, output,
+                           options.context != nullptr
+                               ? &options.context->deviceContext()
+                               : nullptr);
+}
+
+void computeEDTBatch(const std::vector<BatchItem> &items,
+                     const Options &options) {
+  for (const BatchItem &item : items)
+    if (item.mask == nullptr || item.output == nullptr)
+      throw std::runtime_error("The mask and output buffers must not be null");
+  computeDistanceTransformBatch(options, items,
+                                options.context != nullptr
+                                    ? &options.context->deviceContext()
+                                    : nullptr);
+}
+
+} // namespace EucliGPU
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Profiler;
+
+/**
+ * \brief API pública da biblioteca libeucligpu. Trabalha apenas sobre buffers
+ * do chamador, sem nenhuma leitura ou escrita de arquivos.
+*/
+namespace EucliGPU {
+
+class BufferPool;
+class Context;
+
+/**
+ * \brief Implementações disponíveis da transformada de distância.
+ * OpenCL: propagação IWPP no dispositivo OpenCL.
+ * CPU: a mesma propagação IWPP, sequencial, no host.
+ * Exact: transformada separável exata (Felzenszwalb), usada como referência.
+*/
+enum class Engine { OpenCL, CPU, Exact };
+
+const std::vector<Engine> allEngines = {Engine::OpenCL, Engine::CPU,
+                                        Engine::Exact};
+
+std::string engineName(const Engine engine);
+
+Engine parseEngine(const std::string &name);
+
+/**
+ * \brief Métricas da distância ao fundo. Squared é a euclidiana ao quadrado.
+ * As demais usam apenas inteiros na propagação: CityBlock (L1), Chessboard
+ * (L∞) e as chanfradas 3-4 e 5-7-11, normalizadas pelo peso do passo ortogonal.
+*/
+enum class Metric {
+  Euclidean,
+  Squared,
+  CityBlock,
+  Chessboard,
+  Chamfer34,
+  Chamfer5711
+};
+
+const std::vector<Metric> allMetrics = {
+    Metric::Euclidean,  Metric::Squared,   Metric::CityBlock,
+    Metric::Chessboard, Metric::Chamfer34, Metric::Chamfer5711};
+
+std::string metricName(const Metric metric);
+
+Metric parseMetric(const std::string &name);
+
+struct Options {
+  Engine engine = Engine::OpenCL;
+  Metric metric = Metric::Euclidean;
+  // Máscara opcional de obstáculos, com as dimensões da máscara: os pixels
+  // diferentes de 0 bloqueiam a propagação, e a distância passa a ser
+  // geodésica, o menor caminho de 8 vizinhos que os contorna. Só com a métrica
+  // euclidiana e fora de lotes.
+  const uint8_t *obstacles = nullptr;
+  // Distância máxima de interesse, na escala da saída da métrica. As frentes de
+  // onda param nela, e os pixels mais distantes, ou sem fundo, recebem
+  // maxDistance. Em máscaras esparsas, uma faixa estreita evita quase toda a
+  // propagação.
+  float maxDistance = INFINITY;
+  // Quando não nulo, recebe o tempo de cada fase da execução.
+  Profiler *profiler = nullptr;
+  // Quando não nulo, os buffers de trabalho do host vêm dele e voltam para
+  // ele, e as chamadas seguintes os reaproveitam, veja BufferPool.hpp.
+  BufferPool *buffers = nullptr;
+  // Quando não nulo, a engine OpenCL usa o dispositivo e os kernels já
+  // compilados dele, veja Context.hpp. Senão, cada chamada cria e compila os
+  // seus no primeiro dispositivo.
+  Context *context = nullptr;
+  // Com a engine OpenCL e diferente de 0, a máscara e o diagrama de uma imagem
+  // ficam no dispositivo em blocos de tileSize x tileSize pixels durante a
+  // propagação, em vez de ordem de linhas, e os vizinhos verticais de cada
+  // pixel ficam no mesmo bloco. O resultado não muda; lotes ignoram a opção.
+  // No máximo 256.
+  unsigned int tileSize = 0;
+  // Com a engine OpenCL, a propagação de uma imagem lê a máscara de um
+  // image2d_t, pelo cache de texturas, em vez de um buffer. Sem suporte a
+  // imagens no dispositivo, a máscara fica no buffer; lotes ignoram a opção.
+  bool maskImage = false;
+};
+
+/**
+ * \brief Uma máscara de um lote e o buffer de saída correspondente, ambos do
+ * chamador, com width x height elementos em ordem de linhas.
+*/
+struct BatchItem {
+  const uint8_t *mask;
+  unsigned int width;
+  unsigned int height;
+  float *output;
+};
+
+/**
+ * \brief Calcula a distância, na métrica de options, de cada pixel da máscara
+ * ao pixel de fundo (valor 0) mais próximo.
+ * \param mask máscara de width x height pixels, em ordem de linhas.
+ * \param output buffer do chamador com width x height floats, também em ordem
+ * de linhas. Pixels sem nenhum fundo recebem infinito, ou options.maxDistance.
+ * Erros são reportados com std::runtime_error.
+*/
+void computeEDT(const uint8_t *mask, const unsigned int width,
+                const unsigned int height, const Options &options,
+                float *output);
+
+/**
+ * \brief Calcula a transformada de cada máscara do lote, como computeEDT. Com a
+ * engine OpenCL todas as máscaras são empacotadas num único buffer e propagadas
+ * juntas, pagando uma vez só as transferências e os lançamentos do kernel, o
+ * que compensa para muitas máscaras pequenas.
+*/
+void computeEDTBatch(const std::vector<BatchItem> &items,
+                     const Options &options);
+
+} // namespace EucliGPU
@@ -0,0 +1,660 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+
+#include "BufferPool.hpp"
+#include "Engines.hpp"
+#include "Metrics.hpp"
+
+const char *kernelSource() {
+  // Gerado pelo Makefile a partir do kernel.cl.
+  static const char *source =
+#include "kernel.inc"
+  ;
+  return source;
+}
+
+void initVoronoi(const UCImage *image, VoronoiDiagramMap *voronoi,
+                 std::vector<cl_uint4> *queue) {
+  const unsigned int imageWidth = image->attrs.v2[0];
+  const unsigned int imageHeight = image->attrs.v2[1];
+  for (unsigned int x = 0; x < imageWidth; x++)
+    for (unsigned int y = 0; y < imageHeight; y++) {
+      cl_uint4 coordinate = constructCoord(y, x, imageWidth);
+
+      if (isBackgroudByCoord(image, coordinate)) {
+        voronoi->entries[coordinate.v4[2]] =
+          VoronoiDiagramMapEntry{ coordinate, coordinate };
+
+        for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+          cl_uint4 neighbor;
+          if (neighborCoord(coordinate, image->attrs, k, &neighbor) &&
+              !isBackgroudByCoord(image, neighbor)) {
+            queue->push_back(coordinate);
+            break;
+          }
+        }
+      } else {
+        voronoi->entries[coordinate.v4[2]] =
+          VoronoiDiagramMapEntry{ coordinate, constructInvalidCoord() };
+      }
+    }
+}
+
+template <typename M>
+static void propagateCPU(const UCImage *image,
+                         const std::vector<cl_uint4> &pixelQueue,
+                         const VoronoiDiagramMap *voronoi,
+                         std::vector<cl_uint> *updated,
+                         const float maxDistance,
+                         const std::vector<cl_uint> *labels) {
+  const typename M::Distance band = Metrics::bandLimit<M>(maxDistance);
+  const cl_uint invalid = constructInvalidCoord().v4[0];
+  std::deque<cl_uint4> queue(pixelQueue.begin(), pixelQueue.end());
+  while (!queue.empty()) {
+    const cl_uint4 p = queue.front();
+    queue.pop_front();
+
+    const cl_uint4 nearest = voronoi->entries[p.v4[2]].nearestBackground;
+    for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+      cl_uint4 q;
+      if (!neighborCoord(p, image->attrs, k, &q))
+        continue;
+      cl_uint4 area = nearest;
+      // Um vizinho de outra instância tem p como borda, e não o fundo de p.
+      if (labels != nullptr && (*labels)[q.v4[2]] != (*labels)[p.v4[2]])
+        area = constructCoord(p.v4[1], p.v4[0], image->attrs.v2[0]);
+      if (area.v4[0] == invalid)
+        continue;
+      cl_uint4 &curVRQ = voronoi->entries[q.v4[2]].nearestBackground;
+      if (Metrics::closer<M>(q, area, curVRQ, band)) {
+        curVRQ = area;
+        queue.push_back(q);
+        if (updated != nullptr)
+          updated->push_back(q.v4[2]);
+      }
+    }
+  }
+}
+
+void propagateCPU(const UCImage *image, const std::vector<cl_uint4> &pixelQueue,
+                  const VoronoiDiagramMap *voronoi, const Metric metric,
+                  std::vector<cl_uint> *updated, const float maxDistance,
+                  const std::vector<cl_uint> *labels) {
+  Metrics::dispatch(metric, [&](auto m) {
+    propagateCPU<decltype(m)>(image, pixelQueue, voronoi, updated, maxDistance,
+                              labels);
+  });
+}
+
+template <typename M>
+static void sequentialDT(const UCImage *image, float *imageOutput) {
+
+  for(unsigned int x=0; x < image->attrs.v2[0]; ++x) {
+    for(unsigned int y=0; y < image->attrs.v2[1]; ++y) {
+
+      float minDistance = std::numeric_limits<float>::infinity();
+
+      cl_uint4 coord1 = constructCoord(y, x, image->attrs.v2[0]);
+      for(unsigned int innerX = 0; innerX < image->attrs.v2[0]; ++innerX) {
+        for(unsigned int innerY = 0; innerY < image->attrs.v2[1]; ++innerY) {
+
+          const cl_uint4 coord2 = constructCoord(innerY, innerX, image->attrs.v2[0]);
+
+          // Assim como na propagação, as sementes são os pixels de fundo.
+          if(isBackgroudByCoord(image, coord2)) {
+            const float distance = M::value(M::distance(coord1, coord2));
+
+            if(distance < minDistance)
+              minDistance = distance;
+            
+          }
+        }
+      }
+      imageOutput[image->attrs.v2[0]*y + x] = minDistance;
+    }
+  }
+
+}
+
+void sequentialDT(const UCImage *image, float *imageOutput,
+                  const Metric metric) {
+  Metrics::dispatch(metric, [&](auto m) {
+    sequentialDT<decltype(m)>(image, imageOutput);
+  });
+}
+
+/**
+ * \brief Abscissa da interseção das parábolas com vértices em q e r.
+*/
+static double intersection(const std::vector<double> &f, const int q, const int r) {
+  return ((f[q] + (double) q * q) - (f[r] + (double) r * r)) /
+         (2.0 * q - 2.0 * r);
+}
+
+/**
+ * \brief Transformada de distância unidimensional de Felzenszwalb e Huttenlocher
+ * sobre as distâncias ao quadrado, com o envelope inferior de parábolas.
+*/
+static void squaredDT1D(const std::vector<double> &f, std::vector<double> &d) {
+  const int n = f.size();
+  std::vector<int> v(n);
+  std::vector<double> z(n + 1);
+  const double infinity = std::numeric_limits<double>::infinity();
+
+  // Os pixels sem semente são ignorados para não gerar parábolas infinitas.
+  int k = -1;
+  for (int q = 0; q < n; q++) {
+    if (f[q] == infinity)
+      continue;
+    if (k < 0) {
+      k = 0;
+      v[0] = q;
+      z[0] = -infinity;
+      z[1] = infinity;
+      continue;
+    }
+    // Como z[0] é -infinito, o laço sempre para em k >= 0.
+    double s = intersection(f, q, v[k]);
+    while (s <= z[k]) {
+      k--;
+      s = intersection(f, q, v[k]);
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = infinity;
+  }
+
+  if (k < 0) {
+    std::fill(d.begin(), d.end(), infinity);
+    return;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q)
+      k++;
+    d[q] = (double) (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+/**
+ * \brief Distâncias euclidianas ao quadrado exatas, pela transformada separável
+ * aplicada nas colunas e depois nas linhas.
+*/
+static void squaredEDT(const UCImage *image, std::vector<double> &squared) {
+  const unsigned int width = image->attrs.v2[0];
+  const unsigned int height = image->attrs.v2[1];
+  const double infinity = std::numeric_limits<double>::infinity();
+  std::vector<double> columns(static_cast<size_t>(width) * height);
+
+  std::vector<double> f(height), d(height);
+  for (unsigned int x = 0; x < width; x++) {
+    for (unsigned int y = 0; y < height; y++)
+      f[y] = image->image[y * width + x] == 0 ? 0 : infinity;
+    squaredDT1D(f, d);
+    for (unsigned int y = 0; y < height; y++)
+      columns[y * width + x] = d[y];
+  }
+
+  squared.resize(columns.size());
+  f.resize(width);
+  d.resize(width);
+  for (unsigned int y = 0; y < height; y++) {
+    std::copy(columns.begin() + y * width, columns.begin() + (y + 1) * width,
+              f.begin());
+    squaredDT1D(f, d);
+    std::copy(d.begin(), d.end(), squared.begin() + y * width);
+  }
+}
+
+/**
+ * \brief Transformada chanfrada em duas varreduras da imagem, uma em ordem de
+ * linhas com a metade da máscara já visitada e outra na ordem inversa com a
+ * metade simétrica. É exata para a métrica M, cuja distância é o caminho mais
+ * barato pelos passos da máscara.
+*/
+template <typename M>
+static void chamferDT(const UCImage *image, float *imageOutput) {
+  const int width = image->attrs.v2[0];
+  const int height = image->attrs.v2[1];
+  const cl_ulong infinity = std::numeric_limits<cl_ulong>::max();
+  const std::vector<Metrics::ChamferStep> steps = M::steps();
+  std::vector<cl_ulong> distances(static_cast<size_t>(width) * height);
+  for (size_t i = 0; i < distances.size(); i++)
+    distances[i] = image->image[i] == 0 ? 0 : infinity;
+
+  const auto relax = [&](const int x, const int y, const int sign) {
+    cl_ulong &distance = distances[static_cast<size_t>(y) * width + x];
+    for (const Metrics::ChamferStep &step : steps) {
+      const int nx = x - sign * step.dx, ny = y - sign * step.dy;
+      if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+        continue;
+      const cl_ulong neighbor = distances[static_cast<size_t>(ny) * width + nx];
+      if (neighbor != infinity && neighbor + step.weight < distance)
+        distance = neighbor + step.weight;
+    }
+  };
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      relax(x, y, 1);
+  for (int y = height - 1; y >= 0; y--)
+    for (int x = width - 1; x >= 0; x--)
+      relax(x, y, -1);
+
+  for (size_t i = 0; i < distances.size(); i++)
+    imageOutput[i] = distances[i] == infinity
+                         ? std::numeric_limits<float>::infinity()
+                         : M::value(distances[i]);
+}
+
+void exactDT(const UCImage *image, float *imageOutput, const Metric metric,
+             const float maxDistance) {
+  switch (metric) {
+  case Metric::Euclidean:
+  case Metric::Squared: {
+    std::vector<double> squared;
+    squaredEDT(image, squared);
+    for (size_t i = 0; i < squared.size(); i++)
+      imageOutput[i] = metric == Metric::Squared ? squared[i]
+                                                 : std::sqrt(squared[i]);
+    break;
+  }
+  case Metric::CityBlock: chamferDT<Metrics::CityBlock>(image, imageOutput); break;
+  case Metric::Chessboard: chamferDT<Metrics::Chessboard>(image, imageOutput); break;
+  case Metric::Chamfer34: chamferDT<Metrics::Chamfer34>(image, imageOutput); break;
+  case Metric::Chamfer5711: chamferDT<Metrics::Chamfer5711>(image, imageOutput); break;
+  }
+
+  // A transformada exata não tem frente de onda para interromper, então a
+  // faixa só satura o resultado.
+  if (maxDistance < std::numeric_limits<float>::infinity()) {
+    const size_t size = static_cast<size_t>(image->attrs.v2[0]) * image->attrs.v2[1];
+    for (size_t i = 0; i < size; i++)
+      imageOutput[i] = std::min(imageOutput[i], maxDistance);
+  }
+}
+
+template <typename M>
+static void computeDistances(const UCImage *image,
+                             const VoronoiDiagramMap *voronoi,
+                             float *imageOutput, const float maxDistance) {
+  const unsigned int imageWidth = image->attrs.v2[0];
+  const unsigned int imageHeight = image->attrs.v2[1];
+  const unsigned int invalid = constructInvalidCoord().v4[0];
+  for (unsigned int y = 0; y < imageHeight; y++)
+    for (unsigned int x = 0; x < imageWidth; x++) {
+      const cl_uint4 coordinate = constructCoord(y, x, imageWidth);
+      const cl_uint4 nearest =
+          voronoi->entries[coordinate.v4[2]].nearestBackground;
+
+      imageOutput[coordinate.v4[2]] =
+          nearest.v4[0] == invalid
+              ? maxDistance
+              : std::min(M::value(M::distance(coordinate, nearest)), maxDistance);
+    }
+}
+
+void computeDistances(const UCImage *image, const VoronoiDiagramMap *voronoi,
+                      float *imageOutput, const Metric metric,
+                      const float maxDistance) {
+  Metrics::dispatch(metric, [&](auto m) {
+    computeDistances<decltype(m)>(image, voronoi, imageOutput, maxDistance);
+  });
+}
+
+template <typename M>
+static void computeDistances(const UCImage *image,
+                             const VoronoiDiagramMap *voronoi,
+                             const std::vector<cl_uint> &pixels,
+                             float *imageOutput, const float maxDistance) {
+  const unsigned int imageWidth = image->attrs.v2[0];
+  const unsigned int invalid = constructInvalidCoord().v4[0];
+  for (const cl_uint pixel : pixels) {
+    const cl_uint4 coordinate =
+        constructCoord(pixel / imageWidth, pixel % imageWidth, imageWidth);
+    const cl_uint4 nearest = voronoi->entries[pixel].nearestBackground;
+    imageOutput[pixel] =
+        nearest.v4[0] == invalid
+            ? maxDistance
+            : std::min(M::value(M::distance(coordinate, nearest)), maxDistance);
+  }
+}
+
+void computeDistances(const UCImage *image, const VoronoiDiagramMap *voronoi,
+                      const std::vector<cl_uint> &pixels, float *imageOutput,
+                      const Metric metric, const float maxDistance) {
+  Metrics::dispatch(metric, [&](auto m) {
+    computeDistances<decltype(m)>(image, voronoi, pixels, imageOutput,
+                                  maxDistance);
+  });
+}
+
+void initGeodesic(const UCImage *image, const UCImage *obstacles,
+                  std::vector<cl_uint> &costs, std::vector<cl_uint4> *queue) {
+  const unsigned int imageWidth = image->attrs.v2[0];
+  const unsigned int imageHeight = image->attrs.v2[1];
+  costs.assign(static_cast<size_t>(imageWidth) * imageHeight, UINT_MAX);
+  for (unsigned int y = 0; y < imageHeight; y++)
+    for (unsigned int x = 0; x < imageWidth; x++) {
+      const cl_uint4 coordinate = constructCoord(y, x, imageWidth);
+      // Um obstáculo nunca é semente, mesmo sobre um pixel de fundo.
+      if (!isBackgroudByCoord(image, coordinate) ||
+          !isBackgroudByCoord(obstacles, coordinate))
+        continue;
+      costs[coordinate.v4[2]] = 0;
+
+      for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+        cl_uint4 neighbor;
+        if (neighborCoord(coordinate, image->attrs, k, &neighbor) &&
+            !isBackgroudByCoord(image, neighbor)) {
+          queue->push_back(coordinate);
+          break;
+        }
+      }
+    }
+}
+
+/**
+ * \brief Custo em ponto fixo do passo de p para o vizinho q, o mesmo do kernel.
+*/
+static cl_uint geodesicStep(const cl_uint4 &p, const cl_uint4 &q) {
+  return q.v4[0] != p.v4[0] && q.v4[1] != p.v4[1] ? GEODESIC_DIAGONAL
+                                                  : GEODESIC_ORTHOGONAL;
+}
+
+cl_uint geodesicCostLimit(const float maxDistance) {
+  const float scaled = std::floor(maxDistance * GEODESIC_ORTHOGONAL);
+  return scaled >= static_cast<float>(UINT_MAX) ? UINT_MAX
+                                                : static_cast<cl_uint>(scaled);
+}
+
+void propagateGeodesicCPU(const UCImage *obstacles,
+                          const std::vector<cl_uint4> &pixelQueue,
+                          std::vector<cl_uint> &costs, const cl_uint maxCost) {
+  std::deque<cl_uint4> queue(pixelQueue.begin(), pixelQueue.end());
+  while (!queue.empty()) {
+    const cl_uint4 p = queue.front();
+    queue.pop_front();
+
+    for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+      cl_uint4 q;
+      if (!neighborCoord(p, obstacles->attrs, k, &q) ||
+          !isBackgroudByCoord(obstacles, q))
+        continue;
+      const cl_uint candidate = costs[p.v4[2]] + geodesicStep(p, q);
+      if (candidate <= maxCost && candidate < costs[q.v4[2]]) {
+        costs[q.v4[2]] = candidate;
+        queue.push_back(q);
+      }
+    }
+  }
+}
+
+void exactGeodesicDT(const UCImage *image, const UCImage *obstacles,
+                     float *imageOutput, const float maxDistance) {
+  const cl_uint maxCost = geodesicCostLimit(maxDistance);
+  std::vector<cl_uint> costs;
+  std::vector<cl_uint4> seeds;
+  initGeodesic(image, obstacles, costs, &seeds);
+
+  // Dijkstra: cada pixel sai da fila de prioridade uma vez com o custo final.
+  using Entry = std::pair<cl_uint, cl_uint>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  for (const cl_uint4 &seed : seeds)
+    queue.push({0, seed.v4[2]});
+  const unsigned int width = image->attrs.v2[0];
+  while (!queue.empty()) {
+    const Entry entry = queue.top();
+    queue.pop();
+    if (entry.first != costs[entry.second])
+      continue;
+
+    const cl_uint4 p =
+        constructCoord(entry.second / width, entry.second % width, width);
+    for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+      cl_uint4 q;
+      if (!neighborCoord(p, obstacles->attrs, k, &q) ||
+          !isBackgroudByCoord(obstacles, q))
+        continue;
+      const cl_uint candidate = entry.first + geodesicStep(p, q);
+      if (candidate <= maxCost && candidate < costs[q.v4[2]]) {
+        costs[q.v4[2]] = candidate;
+        queue.push({candidate, q.v4[2]});
+      }
+    }
+  }
+  geodesicDistances(costs, imageOutput, maxDistance);
+}
+
+void geodesicDistances(const std::vector<cl_uint> &costs, float *imageOutput,
+                       const float maxDistance) {
+  for (size_t i = 0; i < costs.size(); i++)
+    imageOutput[i] =
+        costs[i] == UINT_MAX
+            ? maxDistance
+            : std::min(static_cast<float>(costs[i]) / GEODESIC_ORTHOGONAL,
+                       maxDistance);
+}
+
+/**
+ * \brief Transformada geodésica com a engine de options, contornando os
+ * obstáculos de options.obstacles.
+*/
+static void geodesicTransform(const EucliGPU::Options &options,
+                              const UCImage *image, float *imageOutput,
+                              OpenCLUtils::DeviceContext *deviceContext) {
+  if (options.metric != Metric::Euclidean)
+    throw std::runtime_error(
+        "The geodesic distance only supports the euclidean metric");
+  Profiler *profiler = options.profiler;
+  const UCImage obstacles =
+      constructUCImage(const_cast<uint8_t *>(options.obstacles),
+                       image->attrs.v2[1], image->attrs.v2[0]);
+  if (options.engine == Engine::Exact) {
+    Profiler::ScopedPhase phase(profiler, "kernel");
+    exactGeodesicDT(image, &obstacles, imageOutput, options.maxDistance);
+    return;
+  }
+
+  Profiler::ScopedPhase seedPhase(profiler, "seed");
+  std::vector<cl_uint> costs;
+  std::vector<cl_uint4> queue;
+  initGeodesic(image, &obstacles, costs, &queue);
+  seedPhase.stop();
+
+  const cl_uint maxCost = geodesicCostLimit(options.maxDistance);
+  if (!queue.empty()) {
+    if (options.engine == Engine::OpenCL) {
+      const std::vector<cl_uint4> imageTable = {
+          {0, image->attrs.v2[0], image->attrs.v2[1], 0}};
+      if (deviceContext != nullptr) {
+        OpenCLUtils::executeGeodesic(*deviceContext, obstacles.image,
+                                     imageTable, queue, costs, profiler,
+                                     maxCost);
+      } else {
+        Profiler::ScopedPhase setupPhase(profiler, "setup");
+        OpenCLUtils::DeviceContext context(OpenCLUtils::getDevice(0),
+                                           kernelSource());
+        setupPhase.stop();
+        OpenCLUtils::executeGeodesic(context, obstacles.image, imageTable,
+                                     queue, costs, profiler, maxCost);
+      }
+    } else {
+      Profiler::ScopedPhase phase(profiler, "kernel");
+      propagateGeodesicCPU(&obstacles, queue, costs, maxCost);
+    }
+  }
+
+  Profiler::ScopedPhase finalizePhase(profiler, "finalize");
+  geodesicDistances(costs, imageOutput, options.maxDistance);
+}
+
+void checkMaxDistance(const float maxDistance) {
+  // A comparação também recusa NaN.
+  if (!(maxDistance >= 0))
+    throw std::runtime_error("The maximum distance must not be negative");
+}
+
+void computeDistanceTransform(const EucliGPU::Options &options,
+                              const UCImage *image, float *imageOutput,
+                              OpenCLUtils::DeviceContext *deviceContext) {
+  checkMaxDistance(options.maxDistance);
+  if (options.tileSize > 256)
+    throw std::runtime_error("The tile size must be at most 256");
+  if (options.obstacles != nullptr)
+    return geodesicTransform(options, image, imageOutput, deviceContext);
+
+  const Engine engine = options.engine;
+  Profiler *profiler = options.profiler;
+  if (engine == Engine::Exact) {
+    Profiler::ScopedPhase phase(profiler, "kernel");
+    exactDT(image, imageOutput, options.metric, options.maxDistance);
+    return;
+  }
+
+  Profiler::ScopedPhase seedPhase(profiler, "seed");
+  // Sem o pool do chamador, os buffers duram só esta chamada.
+  EucliGPU::BufferPool localBuffers;
+  EucliGPU::BufferPool &buffers =
+      options.buffers != nullptr ? *options.buffers : localBuffers;
+  // initVoronoi escreve todas as entradas, e o bloco não precisa ser zerado.
+  const EucliGPU::BufferPool::Lease<VoronoiDiagramMapEntry> entries =
+      buffers.acquire<VoronoiDiagramMapEntry>(
+          static_cast<size_t>(image->attrs.v2[0]) * image->attrs.v2[1]);
+  VoronoiDiagramMap voronoi;
+  voronoi.sizeOfDiagram = entries.size();
+  voronoi.entries = entries.data();
+  // É usado o vector pois é mais fácil extrair o array primitivo para se passar a
+  // posteriori ao kernel.
+  EucliGPU::BufferPool::Queue queue(buffers, entries.size());
+  initVoronoi(image, &voronoi, &*queue);
+  seedPhase.stop();
+
+  // Wavefront propagation
+  if (!queue->empty()) {
+    const std::string defines = Metrics::kernelDefines(options.metric);
+    OpenCLUtils::DeviceLayout layout;
+    layout.tileSize = options.tileSize;
+    layout.maskImage = options.maskImage;
+    if (engine == Engine::OpenCL && deviceContext != nullptr) {
+      OpenCLUtils::executeOpenCL(*deviceContext, KERNELNAME, image, *queue,
+                                 &voronoi, profiler, defines,
+                                 Metrics::bandLimit(options.metric,
+                                                    options.maxDistance),
+                                 layout);
+    } else if (engine == Engine::OpenCL) {
+      OpenCLUtils::executeOpenCL(KERNELNAME, kernelSource(), image, *queue,
+                                 &voronoi, profiler, defines,
+                                 Metrics::bandLimit(options.metric,
+                                                    options.maxDistance),
+                                 layout);
+    } else {
+      Profiler::ScopedPhase phase(profiler, "kernel");
+      propagateCPU(image, *queue, &voronoi, options.metric, nullptr,
+                   options.maxDistance);
+    }
+  }
+
+  Profiler::ScopedPhase finalizePhase(profiler, "finalize");
+  computeDistances(image, &voronoi, imageOutput, options.metric,
+                   options.maxDistance);
+}
+
+void computeDistanceTransformBatch(const EucliGPU::Options &options,
+                                   const std::vector<EucliGPU::BatchItem> &items,
+                                   OpenCLUtils::DeviceContext *deviceContext) {
+  Profiler *profiler = options.profiler;
+  checkMaxDistance(options.maxDistance);
+  if (options.obstacles != nullptr)
+    throw std::runtime_error("Obstacle masks are not supported in batches");
+  if (options.engine != Engine::OpenCL) {
+    for (const EucliGPU::BatchItem &item : items) {
+      const UCImage image = constructUCImage(const_cast<uint8_t *>(item.mask),
+                                             item.height, item.width);
+      computeDistanceTransform(options, &image, item.output);
+    }
+    return;
+  }
+
+  // Cada imagem ocupa, na máscara e no diagrama concatenados, o intervalo que
+  // começa no seu deslocamento na imageTable.
+  Profiler::ScopedPhase seedPhase(profiler, "seed");
+  std::vector<cl_uint4> imageTable;
+  size_t totalSize = 0;
+  for (const EucliGPU::BatchItem &item : items) {
+    imageTable.push_back({static_cast<cl_uint>(totalSize), item.width,
+                          item.height, 0});
+    totalSize += static_cast<size_t>(item.width) * item.height;
+  }
+  if (totalSize > std::numeric_limits<cl_uint>::max())
+    throw std::runtime_error("The batch has more pixels than the kernel can "
+                             "address, split it in smaller batches");
+
+  EucliGPU::BufferPool localBuffers;
+  EucliGPU::BufferPool &buffers =
+      options.buffers != nullptr ? *options.buffers : localBuffers;
+  const EucliGPU::BufferPool::Lease<cl_uchar> masks =
+      buffers.acquire<cl_uchar>(totalSize);
+  const EucliGPU::BufferPool::Lease<VoronoiDiagramMapEntry> entries =
+      buffers.acquire<VoronoiDiagramMapEntry>(totalSize);
+  EucliGPU::BufferPool::Queue queue(buffers, totalSize);
+  for (size_t i = 0; i < items.size(); i++) {
+    const size_t offset = imageTable[i].v4[0];
+    const size_t size = static_cast<size_t>(items[i].width) * items[i].height;
+    std::copy(items[i].mask, items[i].mask + size, masks.data() + offset);
+
+    const UCImage image = constructUCImage(masks.data() + offset,
+                                           items[i].height, items[i].width);
+    VoronoiDiagramMap voronoi;
+    voronoi.sizeOfDiagram = size;
+    voronoi.entries = entries.data() + offset;
+    const size_t queueBegin = queue->size();
+    initVoronoi(&image, &voronoi, &*queue);
+    for (size_t j = queueBegin; j < queue->size(); j++)
+      (*queue)[j].v4[3] = i;
+  }
+  seedPhase.stop();
+
+  VoronoiDiagramMap voronoi;
+  voronoi.sizeOfDiagram = totalSize;
+  voronoi.entries = entries.data();
+  if (!queue->empty()) {
+    const std::string defines = Metrics::kernelDefines(options.metric);
+    if (deviceContext != nullptr) {
+      OpenCLUtils::executeOpenCL(*deviceContext, KERNELNAME, masks.data(),
+                                 imageTable, *queue, &voronoi, profiler,
+                                 defines,
+                                 Metrics::bandLimit(options.metric,
+                                                    options.maxDistance));
+    } else {
+      Profiler::ScopedPhase setupPhase(profiler, "setup");
+      OpenCLUtils::DeviceContext context(OpenCLUtils::getDevice(0),
+                                         kernelSource());
+      setupPhase.stop();
+      OpenCLUtils::executeOpenCL(context, KERNELNAME, masks.data(), imageTable,
+                                 *queue, &voronoi, profiler, defines,
+                                 Metrics::bandLimit(options.metric,
+                                                    options.maxDistance));
+    }
+  }
+
+  Profiler::ScopedPhase finalizePhase(profiler, "finalize");
+  for (size_t i = 0; i < items.size(); i++) {
+    const size_t offset = imageTable[i].v4[0];
+    const UCImage image = constructUCImage(masks.data() + offset,
+                                           items[i].height, items[i].width);
+    VoronoiDiagramMap imageVoronoi;
+    imageVoronoi.sizeOfDiagram =
+        static_cast<size_t>(items[i].width) * items[i].height;
+    imageVoronoi.entries = entries.data() + offset;
+    computeDistances(&image, &imageVoronoi, items[i].output, options.metric,
+                     options.maxDistance);
+  }
+}
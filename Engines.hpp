@@ -0,0 +1,140 @@
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <vector>
+
+#include "DistanceTransform.hpp"
+#include "OpenCLUtils.hpp"
+
+#define KERNELNAME "euclidean"
+
+using EucliGPU::Engine;
+using EucliGPU::Metric;
+
+/**
+ * \brief Código fonte do kernel.cl, embutido na biblioteca durante a compilação.
+*/
+const char *kernelSource();
+
+/**
+ * \brief Inicializa o diagrama de Voronoi: os pixels de fundo são o seu próprio
+ * pixel mais próximo e os demais ficam inválidos. Os pixels de fundo vizinhos a
+ * algum pixel que não é fundo formam a fila inicial da propagação.
+*/
+void initVoronoi(const UCImage *image, VoronoiDiagramMap *voronoi,
+                 std::vector<cl_uint4> *queue);
+
+/**
+ * \brief Propagação IWPP sequencial, com uma fila FIFO sem limite de tamanho.
+ * Se updated não for nulo, recebe o índice de cada pixel atualizado, com
+ * repetições. Como no kernel, nenhum pixel recebe um fundo mais distante que
+ * maxDistance. Com labels, um rótulo por pixel, cada pixel propaga o seu fundo
+ * só aos vizinhos do mesmo rótulo e é ele próprio o fundo dos demais, como o
+ * kernel compilado com -DINSTANCES.
+*/
+void propagateCPU(const UCImage *image, const std::vector<cl_uint4> &pixelQueue,
+                  const VoronoiDiagramMap *voronoi,
+                  const Metric metric = Metric::Euclidean,
+                  std::vector<cl_uint> *updated = nullptr,
+                  const float maxDistance = INFINITY,
+                  const std::vector<cl_uint> *labels = nullptr);
+
+/**
+ * \brief Transformada por força bruta, comparando cada pixel com todos os pixels
+ * de fundo. É O(n²) e serve apenas para validar a referência em imagens pequenas.
+*/
+void sequentialDT(const UCImage *image, float *imageOutput,
+                  const Metric metric = Metric::Euclidean);
+
+/**
+ * \brief Transformada de distância exata. Para as métricas euclidianas é a
+ * transformada separável, aplicando a transformada unidimensional nas colunas e
+ * depois nas linhas; para as demais, a transformada chanfrada em duas varreduras.
+ * As distâncias acima de maxDistance são saturadas.
+*/
+void exactDT(const UCImage *image, float *imageOutput,
+             const Metric metric = Metric::Euclidean,
+             const float maxDistance = INFINITY);
+
+/**
+ * \brief Calcula a distância de cada pixel ao seu pixel de fundo mais próximo,
+ * saturada em maxDistance. Pixels sem nenhum fundo alcançável recebem
+ * maxDistance, infinito sem faixa.
+*/
+void computeDistances(const UCImage *image, const VoronoiDiagramMap *voronoi,
+                      float *imageOutput,
+                      const Metric metric = Metric::Euclidean,
+                      const float maxDistance = INFINITY);
+
+/**
+ * \brief Como computeDistances, mas só para os pixels de índice em pixels.
+*/
+void computeDistances(const UCImage *image, const VoronoiDiagramMap *voronoi,
+                      const std::vector<cl_uint> &pixels, float *imageOutput,
+                      const Metric metric = Metric::Euclidean,
+                      const float maxDistance = INFINITY);
+
+// Custos de passo da distância geodésica em ponto fixo, os mesmos do kernel.cl.
+#define GEODESIC_ORTHOGONAL 256
+#define GEODESIC_DIAGONAL 362
+
+/**
+ * \brief Inicializa os custos da distância geodésica: 0 nos pixels de fundo que
+ * não são obstáculos e UINT_MAX nos demais. As sementes vizinhas a algum pixel
+ * que não é fundo formam a fila inicial.
+*/
+void initGeodesic(const UCImage *image, const UCImage *obstacles,
+                  std::vector<cl_uint> &costs, std::vector<cl_uint4> *queue);
+
+/**
+ * \brief Maior custo em ponto fixo dentro da faixa maxDistance.
+*/
+cl_uint geodesicCostLimit(const float maxDistance);
+
+/**
+ * \brief Propagação geodésica sequencial, com uma fila FIFO: relaxa o custo
+ * acumulado dos 8 vizinhos livres até nenhum custo diminuir. Custos acima de
+ * maxCost não são propagados.
+*/
+void propagateGeodesicCPU(const UCImage *obstacles,
+                          const std::vector<cl_uint4> &pixelQueue,
+                          std::vector<cl_uint> &costs,
+                          const cl_uint maxCost = UINT_MAX);
+
+/**
+ * \brief Distância geodésica exata no grafo de 8 vizinhos, por Dijkstra.
+*/
+void exactGeodesicDT(const UCImage *image, const UCImage *obstacles,
+                     float *imageOutput, const float maxDistance = INFINITY);
+
+/**
+ * \brief Converte os custos em ponto fixo em distâncias, saturadas em
+ * maxDistance, que é também a distância dos pixels que nenhum fundo alcança.
+*/
+void geodesicDistances(const std::vector<cl_uint> &costs, float *imageOutput,
+                       const float maxDistance = INFINITY);
+
+/**
+ * \brief Recusa uma faixa negativa ou NaN.
+*/
+void checkMaxDistance(const float maxDistance);
+
+/**
+ * \brief Executa a transformada de distância com a engine e a métrica de
+ * options, escrevendo a distância de cada pixel em imageOutput, em ordem de
+ * linhas. Com a engine OpenCL, usa deviceContext quando informado, senão cria
+ * um contexto no primeiro dispositivo só para esta execução.
+*/
+void computeDistanceTransform(const EucliGPU::Options &options,
+                              const UCImage *image, float *imageOutput,
+                              OpenCLUtils::DeviceContext *deviceContext = nullptr);
+
+/**
+ * \brief Executa a transformada de todas as máscaras do lote. Com a engine
+ * OpenCL as máscaras são concatenadas e propagadas num único lançamento por
+ * rodada; as demais engines processam uma máscara por vez.
+*/
+void computeDistanceTransformBatch(const EucliGPU::Options &options,
+                                   const std::vector<EucliGPU::BatchItem> &items,
+                                   OpenCLUtils::DeviceContext *deviceContext = nullptr);
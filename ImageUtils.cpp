@@ -0,0 +1,64 @@
+#include <limits>
+
+#include "ImageUtils.hpp"
+
+cl_uint4 constructCoord(unsigned int y, unsigned int x, unsigned int imageWidth) {
+  cl_uint4 coord{x, y, y*imageWidth + x};
+
+  return coord;
+}
+
+cl_uint4 constructInvalidCoord() {
+  const unsigned int maxUInt = std::numeric_limits<unsigned int>::max();
+  cl_uint4 coord{maxUInt, maxUInt};
+  return coord;
+}
+
+cl_float euclideanDistance(const cl_uint4& coord1, const cl_uint4& coord2) {
+  return std::sqrt(std::pow((float) coord1.v4[0] - coord2.v4[0], 2) + std::pow((float) coord1.v4[1] - coord2.v4[1], 2));
+}
+
+cl_uint4 constructPixel(const cl_uint4 coord, const cl_uint value) {
+  cl_uint4 pixel{coord.v4[0], coord.v4[1], coord.v4[2], value};
+  
+  return pixel;
+}
+
+UCImage constructUCImage(unsigned char *image, const unsigned int height, const unsigned int width) {
+  UCImage ucimage;
+  ucimage.image = image;
+  ucimage.attrs.v2[0] = width;
+  ucimage.attrs.v2[1] = height;
+
+  return ucimage;
+}
+
+cl_uchar getValueByCoord(const UCImage *image, const cl_uint4 coord) {
+  return image->image[coord.v4[1] * image->attrs.v2[0] + coord.v4[0]];
+}
+
+bool isBackgroudByCoord(const UCImage *image, const cl_uint4 coord) {
+  return getValueByCoord(image, coord) == 0;
+}
+
+cl_uint4 getPixel(const UCImage *image, const cl_uint4 coordinate) {
+  return constructPixel(coordinate, isBackgroudByCoord(image, coordinate));
+}
+
+cl_uint4 getPixelByCoord(const UCImage *image, cl_int y, cl_int x) {
+  const cl_uint4 coord = constructCoord(y, x, image->attrs.v2[0]);
+  return getPixel(image, coord);
+}
+
+bool isBackgroudByPixel(const cl_uint4 pixel) {
+  return pixel.v4[3];
+}
+
+int get_hash(const VoronoiDiagramMap *map, const cl_uint4 *key) {
+  // Pega o valor do indice da coordenada.
+  return (key->v4[2] % map->sizeOfDiagram);
+}
+
+VoronoiDiagramMapEntry getVoronoiEntry(const VoronoiDiagramMap *map, const cl_uint4 *coord) {
+  return map->entries[get_hash(map, coord)];
+}
@@ -1,4 +1,5 @@
-#include <cassert>
+#pragma once
+
 #include <math.h>
 
 #define CL_USE_DEPRECATED_OPENCL_2_0_APIS
@@ -8,61 +9,41 @@
  * \brief A Coordenada é composta pelo valores de abscissa e ordenada, seguido do indice
  * geral.
 */
-cl_uint4 constructCoord(unsigned int y, unsigned int x, unsigned int imageWidth) {
-  cl_uint4 coord{x, y, y*imageWidth + x};
-
-  return coord;
-}
+cl_uint4 constructCoord(unsigned int y, unsigned int x, unsigned int imageWidth);
 
-cl_uint4 constructInvalidCoord() {
-  const unsigned int maxUInt = std::numeric_limits<unsigned int>::max();
-  cl_uint4 coord{maxUInt, maxUInt};
-  return coord;
-}
+cl_uint4 constructInvalidCoord();
 
 /**
  * \brief Calcula a distância euclideana.
 */
-cl_float euclideanDistance(const cl_uint4& coord1, const cl_uint4& coord2) {
-  return std::sqrt(std::pow((float) coord1.v4[0] - coord2.v4[0], 2) + std::pow((float) coord1.v4[1] - coord2.v4[1], 2));
-}
+cl_float euclideanDistance(const cl_uint4& coord1, const cl_uint4& coord2);
 
 /**
  * \brief Constroi um pixel, representa uma coordenada e um valor.
 */
-cl_uint4 constructPixel(const cl_uint4 coord, const cl_uint value) {
-  cl_uint4 pixel{coord.v4[0], coord.v4[1], coord.v4[2], value};
-  
-  return pixel;
-}
-
-#define MAX_NEIGHBORHOOD 8
+cl_uint4 constructPixel(const cl_uint4 coord, const cl_uint value);
 
-typedef struct {
-  // Há no máximo 8 vizinhos.
-  cl_uint4 pixels[8];
-  // É unsigned char pois pode representar no máximo 8, então não é necessário
-  // mais de um byte.
-  cl_ushort size;
-  
-} Neighborhood;
-
-Neighborhood initNeighborhood() {
-  Neighborhood neighborhood;
-  neighborhood.size = 0;
-
-  return neighborhood;
-}
-
-void addNeighbor(Neighborhood *neighborhood, cl_uint4 pixel) {
-  neighborhood->pixels[neighborhood->size++] = pixel;
-}
+#define NEIGHBOR_COUNT 8
 
-cl_uint4 getNeighbor(const Neighborhood neighborhood, const unsigned char index) {
-  assert(index < neighborhood.size);
-  const cl_uint4 pixel = neighborhood.pixels[index];
+/**
+ * \brief Deslocamentos (x, y) dos vizinhos na janela 3x3, em ordem de linhas e
+ * sem o centro, os mesmos do kernel. Os laços de 0 a NEIGHBOR_COUNT calculam
+ * cada vizinho na hora com neighborCoord, sem montar uma lista de vizinhos.
+*/
+constexpr cl_int neighborOffsets[NEIGHBOR_COUNT][2] = {
+    {-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
 
-  return pixel;
+/**
+ * \brief Coordenada em neighbor do vizinho k de pixel, numa imagem com attrs.
+ * Retorna falso se ele está fora da imagem: x e y são sem sinal, então o -1 da
+ * coluna ou da linha 0 dá a volta e também passa da borda.
+*/
+inline bool neighborCoord(const cl_uint4 &pixel, const cl_uint2 &attrs,
+                          const int k, cl_uint4 *neighbor) {
+  const cl_uint x = pixel.v4[0] + neighborOffsets[k][0];
+  const cl_uint y = pixel.v4[1] + neighborOffsets[k][1];
+  *neighbor = cl_uint4{x, y, y * attrs.v2[0] + x};
+  return x < attrs.v2[0] && y < attrs.v2[1];
 }
 
 typedef struct {
@@ -71,62 +52,17 @@ typedef struct {
 } UCImage;
 
 
-UCImage constructUCImage(unsigned char *image, const unsigned int height, const unsigned int width) {
-  UCImage ucimage;
-  ucimage.image = image;
-  ucimage.attrs.v2[0] = width;
-  ucimage.attrs.v2[1] = height;
+UCImage constructUCImage(unsigned char *image, const unsigned int height, const unsigned int width);
 
-  return ucimage;
-}
+cl_uchar getValueByCoord(const UCImage *image, const cl_uint4 coord);
 
-cl_uchar getValueByCoord(const UCImage *image, const cl_uint4 coord) {
-  return image->image[coord.v4[1] * image->attrs.v2[0] + coord.v4[0]];
-}
+bool isBackgroudByCoord(const UCImage *image, const cl_uint4 coord);
 
-bool isBackgroudByCoord(const UCImage *image, const cl_uint4 coord) {
-  return getValueByCoord(image, coord) == 0;
-}
+cl_uint4 getPixel(const UCImage *image, const cl_uint4 coordinate);
 
-cl_uint4 getPixel(const UCImage *image, const cl_uint4 coordinate) {
-  return constructPixel(coordinate, isBackgroudByCoord(image, coordinate));
-}
+cl_uint4 getPixelByCoord(const UCImage *image, cl_int y, cl_int x);
 
-cl_uint4 getPixelByCoord(const UCImage *image, cl_int y, cl_int x) {
-  const cl_uint4 coord = constructCoord(y, x, image->attrs.v2[0]);
-  return getPixel(image, coord);
-}
-
-bool isBackgroudByPixel(const cl_uint4 pixel) {
-  return pixel.v4[3];
-}
-
-/**
- * \brief Retorna a lista de valores vizinhos ao pixel na imagem.
- * A vizinhança utilizada é a simples, vizinhança direta na janela 3x3.
-*/
-Neighborhood getNeighborhood(const UCImage *image, const cl_uint4& pixel) {
-  Neighborhood neighborhood;
-  neighborhood.size = 0;
-  for (cl_int i = -1; i < 2; i++) {
-    const cl_uint y = pixel.v4[1] - i;
-    if (y >= image->attrs.v2[1])
-      continue;
-
-    for (cl_int j = -1; j < 2; j++) {
-      if (j == 0 && i == 0)
-        continue;
-      const cl_uint x = pixel.v4[0] - j;
-      if (x < 0 || x >= image->attrs.v2[0])
-        continue;
-
-
-      addNeighbor(&neighborhood, getPixelByCoord(image, y, x));
-    }
-  }
-  
-  return neighborhood;
-}
+bool isBackgroudByPixel(const cl_uint4 pixel);
 
 typedef struct {
   cl_uint4 point;
@@ -139,11 +75,6 @@ typedef struct {
 } VoronoiDiagramMap;
 
 
-int get_hash(const VoronoiDiagramMap *map, const cl_uint4 *key) {
-  // Pega o valor do indice da coordenada.
-  return (key->v4[2] % map->sizeOfDiagram);
-}
+int get_hash(const VoronoiDiagramMap *map, const cl_uint4 *key);
 
-VoronoiDiagramMapEntry getVoronoiEntry(const VoronoiDiagramMap *map, const cl_uint4 *coord) {
-  return map->entries[get_hash(map, coord)];
-}
\ No newline at end of file
+VoronoiDiagramMapEntry getVoronoiEntry(const VoronoiDiagramMap *map, const cl_uint4 *coord);
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "Context.hpp"
+#include "Engines.hpp"
+#include "IncrementalEDT.hpp"
+#include "Metrics.hpp"
+
+namespace EucliGPU {
+
+struct IncrementalEDT::Impl {
+  Options options;
+  std::vector<uint8_t> mask;
+  UCImage image;
+  std::vector<VoronoiDiagramMapEntry> entries;
+  VoronoiDiagramMap voronoi;
+  // O de Options::context ou, sem ele, um criado na primeira propagação.
+  std::unique_ptr<OpenCLUtils::DeviceContext> ownedContext;
+  OpenCLUtils::DeviceContext *deviceContext = nullptr;
+  std::vector<uint32_t> changed;
+
+  void propagate(const std::vector<cl_uint4> &queue,
+                 std::vector<cl_uint> *updated) {
+    if (queue.empty())
+      return;
+    if (options.engine == Engine::OpenCL) {
+      if (deviceContext == nullptr && options.context != nullptr)
+        deviceContext = &options.context->deviceContext();
+      if (deviceContext == nullptr) {
+        ownedContext.reset(new OpenCLUtils::DeviceContext(
+            OpenCLUtils::getDevice(0), kernelSource()));
+        deviceContext = ownedContext.get();
+      }
+      OpenCLUtils::executeOpenCL(*deviceContext, KERNELNAME, &image, queue,
+                                 &voronoi, options.profiler,
+                                 Metrics::kernelDefines(options.metric),
+                                 Metrics::bandLimit(options.metric,
+                                                    options.maxDistance));
+    } else {
+      propagateCPU(&image, queue, &voronoi, options.metric, updated,
+                   options.maxDistance);
+    }
+  }
+
+  /**
+   * \brief Onda de aumento: invalida, a partir das sementes removidas, todos os
+   * pixels cujo fundo mais próximo deixou de ser fundo. Os vizinhos desta
+   * região que ainda apontam para um fundo válido formam a borda de onde ela é
+   * repropagada. As regiões de Voronoi da propagação são conexas, então a
+   * busca em largura alcança toda a região de cada semente removida.
+  */
+  void raise(const std::vector<cl_uint4> &removed,
+             std::vector<cl_uint4> &border) {
+    const cl_uint4 invalid = constructInvalidCoord();
+    std::vector<cl_uint4> region(removed);
+    for (const cl_uint4 &seed : removed) {
+      entries[seed.v4[2]].nearestBackground = invalid;
+      changed.push_back(seed.v4[2]);
+    }
+
+    while (!region.empty()) {
+      const cl_uint4 p = region.back();
+      region.pop_back();
+      for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+        cl_uint4 q;
+        if (!neighborCoord(p, image.attrs, k, &q))
+          continue;
+        cl_uint4 &nearest = entries[q.v4[2]].nearestBackground;
+        if (nearest.v4[0] == invalid.v4[0])
+          continue;
+        if (mask[nearest.v4[2]] != 0) {
+          nearest = invalid;
+          changed.push_back(q.v4[2]);
+          region.push_back(q);
+        } else {
+          border.push_back(q);
+        }
+      }
+    }
+  }
+};
+
+IncrementalEDT::IncrementalEDT(const uint8_t *mask, const unsigned int width,
+                               const unsigned int height, const Options &options)
+    : m_impl(new Impl()) {
+  if (mask == nullptr)
+    throw std::runtime_error("The mask buffer must not be null");
+  if (options.engine == Engine::Exact || options.obstacles != nullptr)
+    throw std::runtime_error("Incremental updates only support the cpu and "
+                             "opencl engines, without obstacles");
+  checkMaxDistance(options.maxDistance);
+  Impl &impl = *m_impl;
+  impl.options = options;
+  impl.mask.assign(mask, mask + static_cast<size_t>(width) * height);
+  impl.image = constructUCImage(impl.mask.data(), height, width);
+  impl.entries.resize(impl.mask.size());
+  impl.voronoi.sizeOfDiagram = impl.entries.size();
+  impl.voronoi.entries = impl.entries.data();
+
+  std::vector<cl_uint4> queue;
+  initVoronoi(&impl.image, &impl.voronoi, &queue);
+  impl.propagate(queue, nullptr);
+}
+
+IncrementalEDT::~IncrementalEDT() = default;
+
+unsigned int IncrementalEDT::width() const { return m_impl->image.attrs.v2[0]; }
+
+unsigned int IncrementalEDT::height() const { return m_impl->image.attrs.v2[1]; }
+
+void IncrementalEDT::distances(float *output) const {
+  computeDistances(&m_impl->image, &m_impl->voronoi, output,
+                   m_impl->options.metric, m_impl->options.maxDistance);
+}
+
+void IncrementalEDT::update(const std::vector<MaskChange> &changes,
+                            float *output) {
+  Impl &impl = *m_impl;
+  const unsigned int imageWidth = width();
+  impl.changed.clear();
+
+  // A máscara é alterada antes da onda de aumento, que reconhece as sementes
+  // removidas pelo valor atual da máscara.
+  std::vector<cl_uint4> removed, queue;
+  for (const MaskChange &change : changes) {
+    if (change.x >= imageWidth || change.y >= height())
+      throw std::runtime_error("Mask change outside of the image");
+    const cl_uint4 coordinate = constructCoord(change.y, change.x, imageWidth);
+    uint8_t &pixel = impl.mask[coordinate.v4[2]];
+    const bool wasSeed = pixel == 0, isSeed = change.value == 0;
+    pixel = change.value;
+    if (wasSeed && !isSeed) {
+      removed.push_back(coordinate);
+    } else if (!wasSeed && isSeed) {
+      // Onda de diminuição: a nova semente é o seu próprio fundo mais próximo.
+      impl.entries[coordinate.v4[2]].nearestBackground = coordinate;
+      impl.changed.push_back(coordinate.v4[2]);
+      queue.push_back(coordinate);
+    }
+  }
+
+  impl.raise(removed, queue);
+  // Uma semente removida e recolocada na mesma atualização continua válida.
+  for (const cl_uint4 &coordinate : queue) {
+    cl_uint4 &nearest = impl.entries[coordinate.v4[2]].nearestBackground;
+    if (impl.mask[coordinate.v4[2]] == 0)
+      nearest = coordinate;
+  }
+
+  std::vector<cl_uint> updated;
+  impl.propagate(queue, &updated);
+  impl.changed.insert(impl.changed.end(), updated.begin(), updated.end());
+  std::sort(impl.changed.begin(), impl.changed.end());
+  impl.changed.erase(std::unique(impl.changed.begin(), impl.changed.end()),
+                     impl.changed.end());
+
+  if (output == nullptr)
+    return;
+  // A propagação no dispositivo não informa os pixels atualizados.
+  if (impl.options.engine == Engine::OpenCL)
+    distances(output);
+  else
+    computeDistances(&impl.image, &impl.voronoi, impl.changed, output,
+                     impl.options.metric, impl.options.maxDistance);
+}
+
+const std::vector<uint32_t> &IncrementalEDT::changedPixels() const {
+  return m_impl->changed;
+}
+
+} // namespace EucliGPU
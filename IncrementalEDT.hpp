@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "DistanceTransform.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Novo valor de um pixel da máscara.
+*/
+struct MaskChange {
+  unsigned int x;
+  unsigned int y;
+  uint8_t value;
+};
+
+/**
+ * \brief Transformada de distância mantida entre edições da máscara. O
+ * diagrama de Voronoi fica guardado, e cada atualização só propaga a partir da
+ * região afetada pelos pixels alterados, então o custo acompanha a área
+ * alterada e não o tamanho da imagem.
+ * Suporta as engines CPU e OpenCL, com qualquer métrica e sem obstáculos. Com a
+ * engine OpenCL o diagrama inteiro é transferido a cada atualização, e só a
+ * propagação é proporcional à região afetada.
+*/
+class IncrementalEDT {
+public:
+  /**
+   * \brief Calcula a transformada inicial de uma cópia da máscara.
+  */
+  IncrementalEDT(const uint8_t *mask, const unsigned int width,
+                 const unsigned int height, const Options &options = Options());
+  ~IncrementalEDT();
+
+  unsigned int width() const;
+  unsigned int height() const;
+
+  /**
+   * \brief Escreve a distância de todos os pixels em output.
+  */
+  void distances(float *output) const;
+
+  /**
+   * \brief Aplica as alterações à máscara e atualiza o diagrama. Sementes
+   * removidas (pixels que deixam de ser 0) invalidam as suas regiões, que são
+   * repropagadas a partir da borda; sementes novas propagam normalmente.
+   * Se output não for nulo, deve conter as distâncias anteriores, e só os
+   * pixels alterados são reescritos.
+  */
+  void update(const std::vector<MaskChange> &changes, float *output = nullptr);
+
+  /**
+   * \brief Índices dos pixels cujo pixel de fundo mais próximo mudou na última
+   * atualização, sem repetições. Com a engine OpenCL, que não informa os pixels
+   * atualizados pela propagação, só as regiões invalidadas e as sementes novas.
+  */
+  const std::vector<uint32_t> &changedPixels() const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace EucliGPU
@@ -0,0 +1,239 @@
+#include <stdexcept>
+
+#include "DeviceTransform.hpp"
+#include "Engines.hpp"
+#include "LabelEDT.hpp"
+#include "Profiling.hpp"
+
+namespace EucliGPU {
+
+namespace {
+
+cl::Kernel distancesKernel(DeviceTransform &transform, const cl::Buffer &output,
+                           const float maxDistance) {
+  cl::Kernel kernel(transform.program, "distances");
+  kernel.setArg(0, transform.voronoi);
+  kernel.setArg(1, transform.attrs);
+  kernel.setArg(2, output);
+  kernel.setArg(3, cl_float(maxDistance));
+  return kernel;
+}
+
+template <typename Label>
+void deviceLabelEDT(const Label *labels, const cl_uint2 attrs,
+                    const Options &options, float *distances,
+                    Label *nearestLabels) {
+  Profiler::ScopedPhase setupPhase(options.profiler, "setup");
+  DeviceTransform transform(attrs.v2[0], attrs.v2[1], options);
+  const cl::Context &context = transform.deviceContext.context;
+  const size_t size = transform.size();
+  const cl_uint labelBytes = sizeof(Label);
+  cl::Buffer mask(context, CL_MEM_READ_WRITE, size, nullptr);
+  cl::Buffer distancesBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                             sizeof(cl_float) * size, nullptr);
+  cl::Buffer labelsBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                          labelBytes * size, nullptr);
+  cl::Kernel labelSeeds(transform.program, "labelSeeds");
+  labelSeeds.setArg(1, labelBytes);
+  labelSeeds.setArg(2, attrs);
+  labelSeeds.setArg(3, mask);
+  cl::Kernel distancesPass =
+      distancesKernel(transform, distancesBuffer, options.maxDistance);
+  cl::Kernel nearestLabelsKernel(transform.program, "nearestLabels");
+  nearestLabelsKernel.setArg(0, transform.voronoi);
+  nearestLabelsKernel.setArg(2, labelBytes);
+  nearestLabelsKernel.setArg(3, attrs);
+  nearestLabelsKernel.setArg(4, labelsBuffer);
+  setupPhase.stop();
+
+  const cl::Buffer input = transform.upload(labels, labelBytes * size);
+  labelSeeds.setArg(0, input);
+  transform.runPerPixel(labelSeeds);
+  transform.propagate(mask, options.maxDistance);
+  transform.runPerPixel(distancesPass);
+  nearestLabelsKernel.setArg(1, input);
+  transform.runPerPixel(nearestLabelsKernel);
+
+  transform.readback(distancesBuffer, sizeof(cl_float) * size, distances);
+  transform.readback(labelsBuffer, labelBytes * size, nearestLabels);
+  transform.report();
+}
+
+template <typename Label>
+void hostLabelEDT(const Label *labels, const cl_uint2 attrs,
+                  const Options &options, float *distances,
+                  Label *nearestLabels) {
+  const size_t size = static_cast<size_t>(attrs.v2[0]) * attrs.v2[1];
+  std::vector<cl_uchar> mask(size);
+  for (size_t i = 0; i < size; i++)
+    mask[i] = labels[i] != 0 ? 0 : 255;
+  const UCImage image = constructUCImage(mask.data(), attrs.v2[1], attrs.v2[0]);
+  std::vector<VoronoiDiagramMapEntry> entries(size);
+  VoronoiDiagramMap voronoi;
+  voronoi.sizeOfDiagram = size;
+  voronoi.entries = entries.data();
+  std::vector<cl_uint4> queue;
+  initVoronoi(&image, &voronoi, &queue);
+  propagateCPU(&image, queue, &voronoi, options.metric, nullptr,
+               options.maxDistance);
+
+  computeDistances(&image, &voronoi, distances, options.metric,
+                   options.maxDistance);
+  const cl_uint invalid = constructInvalidCoord().v4[0];
+  for (size_t i = 0; i < size; i++) {
+    const cl_uint4 nearest = entries[i].nearestBackground;
+    nearestLabels[i] = nearest.v4[0] == invalid ? 0 : labels[nearest.v4[2]];
+  }
+}
+
+template <typename Label>
+void deviceInstanceEDT(const Label *labels, const cl_uint2 attrs,
+                       const Options &options, float *distances) {
+  Profiler::ScopedPhase setupPhase(options.profiler, "setup");
+  DeviceTransform transform(attrs.v2[0], attrs.v2[1], options, "-DINSTANCES");
+  const cl::Context &context = transform.deviceContext.context;
+  const size_t size = transform.size();
+  const cl_uint labelBytes = sizeof(Label);
+  cl::Buffer sameLabel(context, CL_MEM_READ_WRITE, size, nullptr);
+  cl::Buffer distancesBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                             sizeof(cl_float) * size, nullptr);
+  cl::Kernel instanceSeeds(transform.program, "instanceSeeds");
+  instanceSeeds.setArg(1, labelBytes);
+  instanceSeeds.setArg(2, attrs);
+  instanceSeeds.setArg(3, sameLabel);
+  instanceSeeds.setArg(4, transform.voronoi);
+  cl::Kernel distancesPass =
+      distancesKernel(transform, distancesBuffer, options.maxDistance);
+  setupPhase.stop();
+
+  const cl::Buffer input = transform.upload(labels, labelBytes * size);
+  instanceSeeds.setArg(0, input);
+  const cl_uint frontierSize = transform.collectFrontier(instanceSeeds, 5);
+  // No lugar da máscara, a propagação lê os vizinhos do mesmo rótulo.
+  transform.propagateFrontier(sameLabel, options.maxDistance, frontierSize);
+  transform.runPerPixel(distancesPass);
+
+  transform.readback(distancesBuffer, sizeof(cl_float) * size, distances);
+  transform.report();
+}
+
+template <typename Label>
+void hostInstanceEDT(const Label *labels, const cl_uint2 attrs,
+                     const Options &options, float *distances) {
+  const unsigned int width = attrs.v2[0], height = attrs.v2[1];
+  const size_t size = static_cast<size_t>(width) * height;
+  const std::vector<cl_uint> wideLabels(labels, labels + size);
+  // A máscara só dá as dimensões da imagem a propagateCPU.
+  std::vector<cl_uchar> mask(size);
+  for (size_t i = 0; i < size; i++)
+    mask[i] = labels[i] != 0 ? 0 : 255;
+  const UCImage image = constructUCImage(mask.data(), height, width);
+  std::vector<VoronoiDiagramMapEntry> entries(size);
+  VoronoiDiagramMap voronoi;
+  voronoi.sizeOfDiagram = size;
+  voronoi.entries = entries.data();
+
+  std::vector<cl_uint4> queue;
+  for (unsigned int y = 0; y < height; y++)
+    for (unsigned int x = 0; x < width; x++) {
+      const cl_uint4 p = constructCoord(y, x, width);
+      entries[p.v4[2]] = VoronoiDiagramMapEntry{
+          p, labels[p.v4[2]] == 0 ? p : constructInvalidCoord()};
+      for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+        cl_uint4 q;
+        if (neighborCoord(p, image.attrs, k, &q) &&
+            labels[q.v4[2]] != labels[p.v4[2]]) {
+          queue.push_back(p);
+          break;
+        }
+      }
+    }
+  propagateCPU(&image, queue, &voronoi, options.metric, nullptr,
+               options.maxDistance, &wideLabels);
+  computeDistances(&image, &voronoi, distances, options.metric,
+                   options.maxDistance);
+}
+
+/**
+ * \brief Valida as opções comuns às transformadas de rótulos e executa device
+ * ou host conforme a engine, com as dimensões da imagem, se ela não for vazia.
+*/
+template <typename Device, typename Host>
+void dispatchLabels(const unsigned int width, const unsigned int height,
+                    const Options &options, const Device &device,
+                    const Host &host) {
+  if (options.engine == Engine::Exact || options.obstacles != nullptr)
+    throw std::runtime_error("Label images only support the opencl and cpu "
+                             "engines, without obstacles");
+  checkMaxDistance(options.maxDistance);
+  if (width == 0 || height == 0)
+    return;
+
+  cl_uint2 attrs;
+  attrs.v2[0] = width;
+  attrs.v2[1] = height;
+  if (options.engine == Engine::OpenCL)
+    device(attrs);
+  else
+    host(attrs);
+}
+
+template <typename Label>
+void labelEDT(const Label *labels, const unsigned int width,
+              const unsigned int height, const Options &options,
+              float *distances, Label *nearestLabels) {
+  if (labels == nullptr || distances == nullptr || nearestLabels == nullptr)
+    throw std::runtime_error("The label and output buffers must not be null");
+  dispatchLabels(
+      width, height, options,
+      [&](const cl_uint2 attrs) {
+        deviceLabelEDT(labels, attrs, options, distances, nearestLabels);
+      },
+      [&](const cl_uint2 attrs) {
+        hostLabelEDT(labels, attrs, options, distances, nearestLabels);
+      });
+}
+
+template <typename Label>
+void instanceEDT(const Label *labels, const unsigned int width,
+                 const unsigned int height, const Options &options,
+                 float *distances) {
+  if (labels == nullptr || distances == nullptr)
+    throw std::runtime_error("The label and output buffers must not be null");
+  dispatchLabels(
+      width, height, options,
+      [&](const cl_uint2 attrs) {
+        deviceInstanceEDT(labels, attrs, options, distances);
+      },
+      [&](const cl_uint2 attrs) {
+        hostInstanceEDT(labels, attrs, options, distances);
+      });
+}
+
+} // namespace
+
+void computeLabelEDT(const uint16_t *labels, const unsigned int width,
+                     const unsigned int height, const Options &options,
+                     float *distances, uint16_t *nearestLabels) {
+  labelEDT(labels, width, height, options, distances, nearestLabels);
+}
+
+void computeLabelEDT(const uint32_t *labels, const unsigned int width,
+                     const unsigned int height, const Options &options,
+                     float *distances, uint32_t *nearestLabels) {
+  labelEDT(labels, width, height, options, distances, nearestLabels);
+}
+
+void computeInstanceEDT(const uint16_t *labels, const unsigned int width,
+                        const unsigned int height, const Options &options,
+                        float *distances) {
+  instanceEDT(labels, width, height, options, distances);
+}
+
+void computeInstanceEDT(const uint32_t *labels, const unsigned int width,
+                        const unsigned int height, const Options &options,
+                        float *distances) {
+  instanceEDT(labels, width, height, options, distances);
+}
+
+} // namespace EucliGPU
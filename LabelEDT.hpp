@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+#include "DistanceTransform.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Transformada de uma imagem de rótulos, que expande os rótulos numa
+ * tesselação de Voronoi discreta numa única propagação. Ao contrário da
+ * máscara de computeEDT, todo pixel com rótulo diferente de 0 é semente da
+ * sua classe, e os de rótulo 0 são os que recebem distância.
+ * \param distances recebe a distância de cada pixel à semente mais próxima,
+ * como computeEDT: infinito, ou options.maxDistance, onde nenhuma chega.
+ * \param nearestLabels recebe o rótulo da semente mais próxima, e 0 onde
+ * nenhuma chega. Entre sementes equidistantes, fica o rótulo da de menor
+ * índice, como em toda propagação.
+ * Com a engine OpenCL os rótulos são enviados como estão, e a máscara das
+ * sementes e os rótulos mais próximos são calculados no dispositivo. A engine
+ * CPU faz o mesmo no host; a Exact não calcula o diagrama e não é suportada,
+ * nem os obstáculos.
+*/
+void computeLabelEDT(const uint16_t *labels, const unsigned int width,
+                     const unsigned int height, const Options &options,
+                     float *distances, uint16_t *nearestLabels);
+
+void computeLabelEDT(const uint32_t *labels, const unsigned int width,
+                     const unsigned int height, const Options &options,
+                     float *distances, uint32_t *nearestLabels);
+
+/**
+ * \brief Transformada interior de cada instância de um mapa de segmentação:
+ * distances recebe, em cada pixel de rótulo diferente de 0, a distância ao
+ * pixel mais próximo de outro rótulo, e 0 nos pixels de rótulo 0. As trocas de
+ * rótulo são bordas, então todas as instâncias, mesmo encostadas umas nas
+ * outras, são calculadas numa única propagação. Como em computeEDT, fora da
+ * imagem não há borda, e uma instância sem nenhuma recebe infinito, ou
+ * options.maxDistance.
+ * Com a engine OpenCL as sementes de cada rótulo são criadas pelo kernel
+ * instanceSeeds, e a propagação é a do kernel euclidean compilado com
+ * -DINSTANCES. As engines suportadas são as de computeLabelEDT.
+*/
+void computeInstanceEDT(const uint16_t *labels, const unsigned int width,
+                        const unsigned int height, const Options &options,
+                        float *distances);
+
+void computeInstanceEDT(const uint32_t *labels, const unsigned int width,
+                        const unsigned int height, const Options &options,
+                        float *distances);
+
+} // namespace EucliGPU
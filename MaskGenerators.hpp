@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Geradores de máscaras sintéticas e reprodutíveis para o benchmark.
+ * Seguindo a convenção do programa, o valor 0 é fundo (semente) e 255 é o
+ * objeto cuja distância ao fundo é calculada.
+*/
+namespace MaskGenerators {
+
+const unsigned char SEED = 0;
+const unsigned char OBJECT = 255;
+
+const std::vector<std::string> patterns = {"sparse", "center", "circles",
+                                           "lines", "checkerboard"};
+
+/**
+ * \brief Sementes aleatórias com a densidade informada.
+*/
+inline std::vector<unsigned char> sparse(const unsigned int width,
+                                         const unsigned int height,
+                                         const double density, const uint32_t seed) {
+  std::vector<unsigned char> mask(static_cast<size_t>(width) * height, OBJECT);
+  std::mt19937 generator(seed);
+  std::bernoulli_distribution isSeed(density);
+  for (unsigned char &pixel : mask)
+    if (isSeed(generator))
+      pixel = SEED;
+  return mask;
+}
+
+/**
+ * \brief Uma única semente no centro, o pior caso para o IWPP, pois a frente de
+ * onda precisa atravessar a imagem inteira.
+*/
+inline std::vector<unsigned char> center(const unsigned int width,
+                                         const unsigned int height) {
+  std::vector<unsigned char> mask(static_cast<size_t>(width) * height, OBJECT);
+  mask[static_cast<size_t>(height / 2) * width + width / 2] = SEED;
+  return mask;
+}
+
+/**
+ * \brief Discos de objeto com centros e raios aleatórios sobre o fundo.
+*/
+inline std::vector<unsigned char> circles(const unsigned int width,
+                                          const unsigned int height,
+                                          const uint32_t seed) {
+  std::vector<unsigned char> mask(static_cast<size_t>(width) * height, SEED);
+  std::mt19937 generator(seed);
+  const unsigned int count = 16;
+  const int maxRadius = std::max(2u, std::min(width, height) / 8);
+  std::uniform_int_distribution<int> centerX(0, width - 1);
+  std::uniform_int_distribution<int> centerY(0, height - 1);
+  std::uniform_int_distribution<int> radius(1, maxRadius);
+  for (unsigned int i = 0; i < count; i++) {
+    const int cx = centerX(generator), cy = centerY(generator);
+    const int r = radius(generator);
+    for (int y = std::max(0, cy - r); y <= std::min<int>(height - 1, cy + r); y++)
+      for (int x = std::max(0, cx - r); x <= std::min<int>(width - 1, cx + r); x++)
+        if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r)
+          mask[static_cast<size_t>(y) * width + x] = OBJECT;
+  }
+  return mask;
+}
+
+/**
+ * \brief Segmentos de reta de sementes, com extremos aleatórios, sobre o objeto.
+*/
+inline std::vector<unsigned char> lines(const unsigned int width,
+                                        const unsigned int height,
+                                        const uint32_t seed) {
+  std::vector<unsigned char> mask(static_cast<size_t>(width) * height, OBJECT);
+  std::mt19937 generator(seed);
+  const unsigned int count = 8;
+  std::uniform_int_distribution<int> pointX(0, width - 1);
+  std::uniform_int_distribution<int> pointY(0, height - 1);
+  for (unsigned int i = 0; i < count; i++) {
+    const int x0 = pointX(generator), y0 = pointY(generator);
+    const int x1 = pointX(generator), y1 = pointY(generator);
+    const int steps = std::max(std::abs(x1 - x0), std::abs(y1 - y0));
+    for (int step = 0; step <= steps; step++) {
+      const int x = steps == 0 ? x0 : x0 + (x1 - x0) * step / steps;
+      const int y = steps == 0 ? y0 : y0 + (y1 - y0) * step / steps;
+      mask[static_cast<size_t>(y) * width + x] = SEED;
+    }
+  }
+  return mask;
+}
+
+/**
+ * \brief Tabuleiro de xadrez com quadrados de lado cellSize.
+*/
+inline std::vector<unsigned char> checkerboard(const unsigned int width,
+                                               const unsigned int height,
+                                               const unsigned int cellSize) {
+  std::vector<unsigned char> mask(static_cast<size_t>(width) * height);
+  for (unsigned int y = 0; y < height; y++)
+    for (unsigned int x = 0; x < width; x++)
+      mask[static_cast<size_t>(y) * width + x] =
+          ((x / cellSize + y / cellSize) % 2 == 0) ? SEED : OBJECT;
+  return mask;
+}
+
+/**
+ * \brief Gera a máscara de um dos padrões pelo nome, com parâmetros
+ * proporcionais ao tamanho da imagem. A densidade só é usada pelo padrão sparse.
+*/
+inline std::vector<unsigned char> generate(const std::string &pattern,
+                                           const unsigned int width,
+                                           const unsigned int height,
+                                           const double density,
+                                           const uint32_t seed) {
+  if (pattern == "sparse")
+    return sparse(width, height, density, seed);
+  if (pattern == "center")
+    return center(width, height);
+  if (pattern == "circles")
+    return circles(width, height, seed);
+  if (pattern == "lines")
+    return lines(width, height, seed);
+  if (pattern == "checkerboard")
+    return checkerboard(width, height, std::max(1u, std::min(width, height) / 16));
+  throw std::runtime_error("Unknown mask pattern " + pattern);
+}
+
+} // namespace MaskGenerators
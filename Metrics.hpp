@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "DistanceTransform.hpp"
+#include "ImageUtils.hpp"
+
+using EucliGPU::Metric;
+
+/**
+ * \brief Métricas das engines do host, usadas como parâmetro de template. Cada
+ * uma define o tipo Distance usado nas comparações da propagação, sempre
+ * inteiro, e value, que converte uma Distance no valor escrito na saída; as
+ * lineares também definem scale, o inverso dessa conversão. As mesmas
+ * fórmulas estão no kernel.cl, escolhidas com -DMETRIC.
+*/
+namespace Metrics {
+
+/**
+ * \brief Passo de uma máscara chanfrada: deslocamento e peso. Só é listada a
+ * metade da máscara com dy > 0, ou dy = 0 e dx > 0; a outra metade é simétrica.
+*/
+struct ChamferStep {
+  int dx;
+  int dy;
+  cl_ulong weight;
+};
+
+/**
+ * \brief Diferenças absolutas entre as coordenadas, a maior em a.
+*/
+inline void sortedDeltas(const cl_uint4 &coord1, const cl_uint4 &coord2,
+                         cl_ulong &a, cl_ulong &b) {
+  const cl_ulong dx = std::max(coord1.v4[0], coord2.v4[0]) -
+                      std::min(coord1.v4[0], coord2.v4[0]);
+  const cl_ulong dy = std::max(coord1.v4[1], coord2.v4[1]) -
+                      std::min(coord1.v4[1], coord2.v4[1]);
+  a = std::max(dx, dy);
+  b = std::min(dx, dy);
+}
+
+/**
+ * \brief Compara o quadrado da distância, exato em 64 bits, e só value tira a
+ * raiz.
+*/
+struct Euclidean {
+  using Distance = cl_ulong;
+  static Distance distance(const cl_uint4 &coord1, const cl_uint4 &coord2) {
+    cl_ulong a, b;
+    sortedDeltas(coord1, coord2, a, b);
+    return a * a + b * b;
+  }
+  static float value(const Distance distance) {
+    return static_cast<float>(std::sqrt(static_cast<double>(distance)));
+  }
+};
+
+struct Squared {
+  using Distance = cl_ulong;
+  static Distance distance(const cl_uint4 &coord1, const cl_uint4 &coord2) {
+    cl_ulong a, b;
+    sortedDeltas(coord1, coord2, a, b);
+    return a * a + b * b;
+  }
+  static constexpr float scale = 1;
+  static float value(const Distance distance) { return distance; }
+};
+
+struct CityBlock {
+  using Distance = cl_ulong;
+  static Distance distance(const cl_uint4 &coord1, const cl_uint4 &coord2) {
+    cl_ulong a, b;
+    sortedDeltas(coord1, coord2, a, b);
+    return a + b;
+  }
+  static constexpr float scale = 1;
+  static float value(const Distance distance) { return distance; }
+  static std::vector<ChamferStep> steps() { return {{1, 0, 1}, {0, 1, 1}}; }
+};
+
+struct Chessboard {
+  using Distance = cl_ulong;
+  static Distance distance(const cl_uint4 &coord1, const cl_uint4 &coord2) {
+    cl_ulong a, b;
+    sortedDeltas(coord1, coord2, a, b);
+    return a;
+  }
+  static constexpr float scale = 1;
+  static float value(const Distance distance) { return distance; }
+  static std::vector<ChamferStep> steps() {
+    return {{1, 0, 1}, {0, 1, 1}, {1, 1, 1}, {-1, 1, 1}};
+  }
+};
+
+/**
+ * \brief Chanfrada 3-4: a passos ortogonais custam 3 e os diagonais 4, então a
+ * distância é b diagonais e a - b ortogonais.
+*/
+struct Chamfer34 {
+  using Distance = cl_ulong;
+  static Distance distance(const cl_uint4 &coord1, const cl_uint4 &coord2) {
+    cl_ulong a, b;
+    sortedDeltas(coord1, coord2, a, b);
+    return 3 * a + b;
+  }
+  static constexpr float scale = 3;
+  static float value(const Distance distance) { return distance / 3.0f; }
+  static std::vector<ChamferStep> steps() {
+    return {{1, 0, 3}, {0, 1, 3}, {1, 1, 4}, {-1, 1, 4}};
+  }
+};
+
+/**
+ * \brief Chanfrada 5-7-11, com o passo de cavalo custando 11. Até a = 2b o
+ * caminho mais barato mistura diagonais e cavalos, depois cavalos e ortogonais.
+*/
+struct Chamfer5711 {
+  using Distance = cl_ulong;
+  static Distance distance(const cl_uint4 &coord1, const cl_uint4 &coord2) {
+    cl_ulong a, b;
+    sortedDeltas(coord1, coord2, a, b);
+    return a >= 2 * b ? 5 * a + b : 4 * a + 3 * b;
+  }
+  static constexpr float scale = 5;
+  static float value(const Distance distance) { return distance / 5.0f; }
+  static std::vector<ChamferStep> steps() {
+    return {{1, 0, 5},  {0, 1, 5},   {1, 1, 7},  {-1, 1, 7},
+            {2, 1, 11}, {-2, 1, 11}, {1, 2, 11}, {-1, 2, 11}};
+  }
+};
+
+/**
+ * \brief Maior Distance dentro da faixa maxDistance, dada na escala de value.
+ * Uma faixa infinita não limita nada. O kernel.cl recebe o limite pronto, para
+ * que as duas propagações parem no mesmo pixel.
+*/
+template <typename M> typename M::Distance bandLimit(const float maxDistance) {
+  if constexpr (std::is_same<M, Euclidean>::value) {
+    // O maior quadrado cuja raiz, como value a calcula, fica na faixa. value
+    // não decresce, então a busca binária leva no máximo 64 passos, mesmo
+    // quando o float arredonda muitos quadrados seguidos para maxDistance.
+    if (M::value(ULONG_MAX) <= maxDistance)
+      return ULONG_MAX;
+    // value(low) <= maxDistance < value(high).
+    cl_ulong low = 0, high = ULONG_MAX;
+    while (high - low > 1) {
+      const cl_ulong middle = low + (high - low) / 2;
+      if (M::value(middle) <= maxDistance)
+        low = middle;
+      else
+        high = middle;
+    }
+    return low;
+  } else {
+    const float scaled = std::floor(maxDistance * M::scale);
+    return scaled >= 0x1p63f ? ULONG_MAX : static_cast<cl_ulong>(scaled);
+  }
+}
+
+/**
+ * \brief Se area está mais perto de q que current, e dentro da faixa band. Um
+ * pixel sem fundo mais próximo (coordenada inválida) está infinitamente longe,
+ * sem passar pela fórmula, que estouraria com as métricas inteiras. Entre
+ * fundos à mesma distância fica o de menor índice, como no kernel.
+*/
+template <typename M>
+bool closer(const cl_uint4 &q, const cl_uint4 &area, const cl_uint4 &current,
+            const typename M::Distance band =
+                std::numeric_limits<typename M::Distance>::max()) {
+  const typename M::Distance candidate = M::distance(q, area);
+  if (candidate > band)
+    return false;
+  if (current.v4[0] == constructInvalidCoord().v4[0])
+    return true;
+  const typename M::Distance distance = M::distance(q, current);
+  return candidate < distance ||
+         (candidate == distance && area.v4[2] < current.v4[2]);
+}
+
+/**
+ * \brief Chama function com uma instância da métrica escolhida, ligando o
+ * enum público aos parâmetros de template das engines.
+*/
+template <typename F> void dispatch(const Metric metric, F &&function) {
+  switch (metric) {
+  case Metric::Euclidean: return function(Euclidean());
+  case Metric::Squared: return function(Squared());
+  case Metric::CityBlock: return function(CityBlock());
+  case Metric::Chessboard: return function(Chessboard());
+  case Metric::Chamfer34: return function(Chamfer34());
+  case Metric::Chamfer5711: return function(Chamfer5711());
+  }
+}
+
+/**
+ * \brief bandLimit da métrica escolhida, o argumento band do kernel euclidean.
+*/
+inline cl_ulong bandLimit(const Metric metric, const float maxDistance) {
+  cl_ulong band = 0;
+  dispatch(metric, [&](auto m) { band = bandLimit<decltype(m)>(maxDistance); });
+  return band;
+}
+
+/**
+ * \brief Opção de compilação da variante do kernel com a métrica. Os valores de
+ * METRIC no kernel.cl seguem a ordem de EucliGPU::Metric.
+*/
+inline std::string kernelDefines(const Metric metric) {
+  return "-DMETRIC=" + std::to_string(static_cast<int>(metric));
+}
+
+} // namespace Metrics
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "DeviceTransform.hpp"
+#include "Morphology.hpp"
+#include "Profiling.hpp"
+
+namespace EucliGPU {
+
+namespace {
+
+/**
+ * \brief Um passo é sempre uma erosão; a dilatação é a erosão do complemento,
+ * seguida de outro complemento. Só o primeiro passo inverte a própria entrada:
+ * entre dois passos, o complemento é feito pelo limiar do anterior.
+*/
+struct Pass {
+  bool invertInput;
+  bool invertOutput;
+};
+
+std::vector<Pass> passes(const Morphology operation) {
+  switch (operation) {
+  case Morphology::Erode: return {{false, false}};
+  case Morphology::Dilate: return {{true, true}};
+  // A abertura grava o complemento da erosão, cuja erosão complementada é a
+  // dilatação.
+  case Morphology::Open: return {{false, true}, {false, true}};
+  case Morphology::Close: return {{true, true}, {false, false}};
+  }
+  throw std::runtime_error("Unknown morphology operation");
+}
+
+/**
+ * \brief Executa os passos no dispositivo. Cada erosão propaga com a faixa
+ * igual ao raio e limiariza o diagrama na outra máscara, sem sair de lá.
+*/
+void deviceMorphology(const uint8_t *mask, const cl_uint2 attrs,
+                      const std::vector<Pass> &steps, const float radius,
+                      const Options &options, uint8_t *output) {
+  Profiler::ScopedPhase setupPhase(options.profiler, "setup");
+  DeviceTransform transform(attrs.v2[0], attrs.v2[1], options);
+  cl::Kernel invertMask(transform.program, "invertMask");
+  invertMask.setArg(1, attrs);
+  cl::Kernel erodeMask(transform.program, "erodeMask");
+  erodeMask.setArg(0, transform.voronoi);
+  erodeMask.setArg(1, attrs);
+  setupPhase.stop();
+
+  // As máscaras alternam entre entrada e saída dos passos.
+  cl::Buffer masks[2] = {
+      transform.upload(mask),
+      cl::Buffer(transform.deviceContext.context, CL_MEM_READ_WRITE,
+                 transform.size(), nullptr)};
+  int current = 0;
+  if (steps.front().invertInput) {
+    invertMask.setArg(0, masks[current]);
+    invertMask.setArg(2, masks[1 - current]);
+    transform.runPerPixel(invertMask);
+    current = 1 - current;
+  }
+
+  for (const Pass &step : steps) {
+    transform.propagate(masks[current], radius);
+    erodeMask.setArg(2, cl_uint(step.invertOutput));
+    erodeMask.setArg(3, masks[1 - current]);
+    transform.runPerPixel(erodeMask);
+    current = 1 - current;
+  }
+
+  transform.readback(masks[current], transform.size(), output);
+  transform.report();
+}
+
+/**
+ * \brief Executa os passos no host, limiarizando a transformada completa de
+ * cada um. Serve de referência para a versão do dispositivo.
+*/
+void hostMorphology(const uint8_t *mask, const cl_uint2 attrs,
+                    const std::vector<Pass> &steps, const float radius,
+                    const Options &options, uint8_t *output) {
+  const size_t size = static_cast<size_t>(attrs.v2[0]) * attrs.v2[1];
+  std::vector<uint8_t> current(mask, mask + size), next(size);
+  std::vector<float> distances(size);
+  Options edtOptions = options;
+  edtOptions.maxDistance = INFINITY;
+
+  if (steps.front().invertInput)
+    for (uint8_t &pixel : current)
+      pixel = pixel == 0 ? 255 : 0;
+  for (const Pass &step : steps) {
+    computeEDT(current.data(), attrs.v2[0], attrs.v2[1], edtOptions,
+               distances.data());
+    for (size_t i = 0; i < size; i++)
+      next[i] = (distances[i] > radius) != step.invertOutput ? 255 : 0;
+    current.swap(next);
+  }
+  std::copy(current.begin(), current.end(), output);
+}
+
+} // namespace
+
+std::string morphologyName(const Morphology operation) {
+  switch (operation) {
+  case Morphology::Erode: return "erode";
+  case Morphology::Dilate: return "dilate";
+  case Morphology::Open: return "open";
+  case Morphology::Close: return "close";
+  }
+  return "unknown";
+}
+
+Morphology parseMorphology(const std::string &name) {
+  for (const Morphology operation : allMorphologies)
+    if (morphologyName(operation) == name)
+      return operation;
+  throw std::runtime_error("Unknown morphology operation " + name +
+                           ", expected one of erode, dilate, open or close");
+}
+
+void computeMorphology(const uint8_t *mask, const unsigned int width,
+                       const unsigned int height, const Morphology operation,
+                       const float radius, const Options &options,
+                       uint8_t *output) {
+  if (mask == nullptr || output == nullptr)
+    throw std::runtime_error("The mask and output buffers must not be null");
+  if (options.obstacles != nullptr)
+    throw std::runtime_error("Morphology does not support obstacles");
+  if (!(radius >= 0))
+    throw std::runtime_error("The morphology radius must not be negative");
+  if (width == 0 || height == 0)
+    return;
+
+  cl_uint2 attrs;
+  attrs.v2[0] = width;
+  attrs.v2[1] = height;
+  const std::vector<Pass> steps = passes(operation);
+  if (options.engine == Engine::OpenCL)
+    deviceMorphology(mask, attrs, steps, radius, options, output);
+  else
+    hostMorphology(mask, attrs, steps, radius, options, output);
+}
+
+} // namespace EucliGPU
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DistanceTransform.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Operações morfológicas por um disco, na métrica de Options: com
+ * Chessboard o disco é um quadrado, e com CityBlock um losango. Erode afasta o
+ * objeto do fundo, Dilate o expande, Open é a erosão seguida da dilatação e
+ * Close a dilatação seguida da erosão.
+*/
+enum class Morphology { Erode, Dilate, Open, Close };
+
+const std::vector<Morphology> allMorphologies = {
+    Morphology::Erode, Morphology::Dilate, Morphology::Open, Morphology::Close};
+
+std::string morphologyName(const Morphology operation);
+
+Morphology parseMorphology(const std::string &name);
+
+/**
+ * \brief Aplica a operação à máscara, com o disco de raio radius na escala de
+ * saída da métrica. Como na transformada, o valor 0 é fundo e os demais são
+ * objeto; output recebe 0 ou 255 em cada pixel. Um pixel sobrevive à erosão
+ * quando não há fundo a até radius dele, e fora da imagem não há nem fundo nem
+ * objeto.
+ * Com a engine OpenCL a propagação para no raio e o limiar é aplicado no
+ * dispositivo, com os dois passos da abertura e do fechamento encadeados lá, e
+ * apenas a máscara final é lida. As demais engines limiarizam a transformada
+ * completa no host. options.maxDistance é ignorada, e obstáculos não são
+ * aceitos.
+*/
+void computeMorphology(const uint8_t *mask, const unsigned int width,
+                       const unsigned int height, const Morphology operation,
+                       const float radius, const Options &options,
+                       uint8_t *output);
+
+} // namespace EucliGPU
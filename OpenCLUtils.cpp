@@ -0,0 +1,779 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "OpenCLUtils.hpp"
+
+namespace OpenCLUtils {
+
+const char *getErrorString(cl_int error)
+{
+switch(error){
+    // run-time and JIT compiler errors
+    case 0: return "CL_SUCCESS";
+    case -1: return "CL_DEVICE_NOT_FOUND";
+    case -2: return "CL_DEVICE_NOT_AVAILABLE";
+    case -3: return "CL_COMPILER_NOT_AVAILABLE";
+    case -4: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
+    case -5: return "CL_OUT_OF_RESOURCES";
+    case -6: return "CL_OUT_OF_HOST_MEMORY";
+    case -7: return "CL_PROFILING_INFO_NOT_AVAILABLE";
+    case -8: return "CL_MEM_COPY_OVERLAP";
+    case -9: return "CL_IMAGE_FORMAT_MISMATCH";
+    case -10: return "CL_IMAGE_FORMAT_NOT_SUPPORTED";
+    case -11: return "CL_BUILD_PROGRAM_FAILURE";
+    case -12: return "CL_MAP_FAILURE";
+    case -13: return "CL_MISALIGNED_SUB_BUFFER_OFFSET";
+    case -14: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
+    case -15: return "CL_COMPILE_PROGRAM_FAILURE";
+    case -16: return "CL_LINKER_NOT_AVAILABLE";
+    case -17: return "CL_LINK_PROGRAM_FAILURE";
+    case -18: return "CL_DEVICE_PARTITION_FAILED";
+    case -19: return "CL_KERNEL_ARG_INFO_NOT_AVAILABLE";
+
+    // compile-time errors
+    case -30: return "CL_INVALID_VALUE";
+    case -31: return "CL_INVALID_DEVICE_TYPE";
+    case -32: return "CL_INVALID_PLATFORM";
+    case -33: return "CL_INVALID_DEVICE";
+    case -34: return "CL_INVALID_CONTEXT";
+    case -35: return "CL_INVALID_QUEUE_PROPERTIES";
+    case -36: return "CL_INVALID_COMMAND_QUEUE";
+    case -37: return "CL_INVALID_HOST_PTR";
+    case -38: return "CL_INVALID_MEM_OBJECT";
+    case -39: return "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR";
+    case -40: return "CL_INVALID_IMAGE_SIZE";
+    case -41: return "CL_INVALID_SAMPLER";
+    case -42: return "CL_INVALID_BINARY";
+    case -43: return "CL_INVALID_BUILD_OPTIONS";
+    case -44: return "CL_INVALID_PROGRAM";
+    case -45: return "CL_INVALID_PROGRAM_EXECUTABLE";
+    case -46: return "CL_INVALID_KERNEL_NAME";
+    case -47: return "CL_INVALID_KERNEL_DEFINITION";
+    case -48: return "CL_INVALID_KERNEL";
+    case -49: return "CL_INVALID_ARG_INDEX";
+    case -50: return "CL_INVALID_ARG_VALUE";
+    case -51: return "CL_INVALID_ARG_SIZE";
+    case -52: return "CL_INVALID_KERNEL_ARGS";
+    case -53: return "CL_INVALID_WORK_DIMENSION";
+    case -54: return "CL_INVALID_WORK_GROUP_SIZE";
+    case -55: return "CL_INVALID_WORK_ITEM_SIZE";
+    case -56: return "CL_INVALID_GLOBAL_OFFSET";
+    case -57: return "CL_INVALID_EVENT_WAIT_LIST";
+    case -58: return "CL_INVALID_EVENT";
+    case -59: return "CL_INVALID_OPERATION";
+    case -60: return "CL_INVALID_GL_OBJECT";
+    case -61: return "CL_INVALID_BUFFER_SIZE";
+    case -62: return "CL_INVALID_MIP_LEVEL";
+    case -63: return "CL_INVALID_GLOBAL_WORK_SIZE";
+    case -64: return "CL_INVALID_PROPERTY";
+    case -65: return "CL_INVALID_IMAGE_DESCRIPTOR";
+    case -66: return "CL_INVALID_COMPILER_OPTIONS";
+    case -67: return "CL_INVALID_LINKER_OPTIONS";
+    case -68: return "CL_INVALID_DEVICE_PARTITION_COUNT";
+
+    // extension errors
+    case -1000: return "CL_INVALID_GL_SHAREGROUP_REFERENCE_KHR";
+    case -1001: return "CL_PLATFORM_NOT_FOUND_KHR";
+    case -1002: return "CL_INVALID_D3D10_DEVICE_KHR";
+    case -1003: return "CL_INVALID_D3D10_RESOURCE_KHR";
+    case -1004: return "CL_D3D10_RESOURCE_ALREADY_ACQUIRED_KHR";
+    case -1005: return "CL_D3D10_RESOURCE_NOT_ACQUIRED_KHR";
+    default: return "Unknown OpenCL error";
+    }
+}
+
+std::vector<cl::Device> getDevices() {
+  std::vector<cl::Platform> platforms;
+  cl::Platform::get(&platforms);
+
+  if (platforms.size() == 0) {
+    throw std::runtime_error(
+        "There is no platforms available. Check OpenCL installation!");
+  }
+
+  // Os dispositivos de todas as plataformas são numerados em sequência.
+  std::vector<cl::Device> devices;
+  for (const cl::Platform &platform : platforms) {
+    std::vector<cl::Device> platformDevices;
+    platform.getDevices(CL_DEVICE_TYPE_ALL, &platformDevices);
+    devices.insert(devices.end(), platformDevices.begin(),
+                   platformDevices.end());
+  }
+  if (devices.size() == 0) {
+    throw std::runtime_error(
+        "There is no devices available. Check OpenCL installation!");
+  }
+
+  return devices;
+}
+
+cl::Device getDevice(int deviceId) {
+  std::vector<cl::Device> devices(getDevices());
+
+  if (deviceId < 0 || deviceId >= static_cast<int>(devices.size())) {
+    throw std::runtime_error("There is just " + std::to_string(devices.size()) +
+                             " devices available, so there is no device id " +
+                             std::to_string(deviceId));
+  }
+
+  return devices[deviceId];
+}
+
+cl::Device userSelectDevice() {
+  std::vector<cl::Device> devices(getDevices());
+
+  for (std::size_t i = 0; i < devices.size(); ++i) {
+    std::cout << "Device " << i << " - " << devices[i].getInfo<CL_DEVICE_NAME>()
+              << std::endl;
+  }
+
+  std::cout << "Select your device id: ";
+  int deviceId;
+  std::cin >> deviceId;
+  cl::Device defaultDevice = devices[deviceId];
+  std::cout << "Using device: " << defaultDevice.getInfo<CL_DEVICE_NAME>()
+            << "\n";
+
+  return defaultDevice;
+}
+
+#ifdef EDT_STATS
+void printPropagationStats(const std::vector<cl_uint> &stats,
+                           const cl_uint rounds) {
+  std::cout << "Pixels processed: " << stats[STAT_PIXELS] << "\n"
+            << "Voronoi updates: " << stats[STAT_UPDATES] << "\n"
+            << "CAS retries: " << stats[STAT_CAS_RETRIES] << "\n"
+            << "Queue overflows: " << stats[STAT_QUEUE_OVERFLOWS] << "\n"
+            << "Propagation rounds: " << rounds << "\n";
+}
+#endif
+
+/**
+ * \brief Arredonda value para cima, até um múltiplo de multiple.
+*/
+static size_t roundUp(const size_t value, const size_t multiple) {
+  return ((value + multiple - 1) / multiple) * multiple;
+}
+
+double getEventMs(const cl::Event &event) {
+  const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+  const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+  return (end - start) * 1e-6;
+}
+
+DeviceContext::DeviceContext(const cl::Device &device,
+                             const std::string &kernelSource)
+    : DeviceContext(device, kernelSource, LaunchConfig()) {}
+
+DeviceContext::DeviceContext(const cl::Device &device,
+                             const std::string &kernelSource,
+                             const LaunchConfig &config)
+    : device(device), config(config), context(device),
+      m_kernelSource(kernelSource) {
+  // Compila já a variante padrão, para que um dispositivo que não compila o
+  // kernel seja descartado na criação.
+  program();
+
+  // A fila é reutilizada entre execuções, então o profiling fica sempre
+  // habilitado para que qualquer execução possa ser medida.
+  queue = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+}
+
+const cl::Program &DeviceContext::program(const std::string &defines) {
+  const auto found = m_programs.find(defines);
+  if (found != m_programs.end())
+    return found->second;
+
+  cl::Program::Sources sources;
+  sources.push_back({m_kernelSource.c_str(), m_kernelSource.length()});
+  cl::Program program(context, sources);
+  std::string buildOptions =
+      "-DQUEUE_CAPACITY=" + std::to_string(config.queueCapacity);
+#ifdef EDT_STATS
+  buildOptions += " -DEDT_STATS";
+#endif
+  if (!defines.empty())
+    buildOptions += " " + defines;
+  if (program.build({device}, buildOptions.c_str()) != CL_SUCCESS) {
+    throw std::runtime_error(
+        "Error building: " +
+        program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
+  }
+  return m_programs.emplace(defines, program).first->second;
+}
+
+std::string DeviceContext::name() const {
+  return device.getInfo<CL_DEVICE_NAME>();
+}
+
+void executeOpenCL(const std::string &kernelName,
+                   const std::string &kernelSource,
+                   const UCImage *image,
+                   const std::vector<cl_uint4>& pixelQueue,
+                   const VoronoiDiagramMap *voronoi,
+                   Profiler *profiler,
+                   const std::string &defines,
+                   const cl_ulong band,
+                   const DeviceLayout &layout) {
+  Profiler::ScopedPhase setupPhase(profiler, "setup");
+  DeviceContext deviceContext(getDevice(0), kernelSource);
+  setupPhase.stop();
+
+  executeOpenCL(deviceContext, kernelName, image, pixelQueue, voronoi,
+                profiler, defines, band, layout);
+}
+
+void executeOpenCL(DeviceContext &deviceContext,
+                   const std::string &kernelName,
+                   const UCImage *image,
+                   const std::vector<cl_uint4>& pixelQueue,
+                   const VoronoiDiagramMap *voronoi,
+                   Profiler *profiler,
+                   const std::string &defines,
+                   const cl_ulong band,
+                   const DeviceLayout &layout) {
+  // Uma imagem é um lote de uma só, e os pixels da fila já têm w = 0.
+  const std::vector<cl_uint4> imageTable = {
+      {0, image->attrs.v2[0], image->attrs.v2[1], 0}};
+  executeOpenCL(deviceContext, kernelName, image->image, imageTable,
+                pixelQueue, voronoi, profiler, defines, band, layout);
+}
+
+FrontierBuffers::FrontierBuffers(DeviceContext &deviceContext,
+                                 const size_t imageSize, const size_t capacity,
+                                 cl::Event *fillEvent)
+    : frontiers{cl::Buffer(deviceContext.context, CL_MEM_READ_WRITE,
+                           sizeof(cl_uint4)*capacity, nullptr),
+                cl::Buffer(deviceContext.context, CL_MEM_READ_WRITE,
+                           sizeof(cl_uint4)*capacity, nullptr)},
+      size(deviceContext.context, CL_MEM_READ_WRITE, sizeof(cl_uint), nullptr),
+      stamps(deviceContext.context, CL_MEM_READ_WRITE,
+             sizeof(cl_uint)*imageSize, nullptr) {
+  const cl_int errorCode = deviceContext.queue.enqueueFillBuffer(
+      stamps, cl_uint(0), 0, sizeof(cl_uint)*imageSize, nullptr, fillEvent);
+  if (errorCode != CL_SUCCESS)
+    throw std::runtime_error(getErrorString(errorCode));
+}
+
+cl_uint propagateRounds(DeviceContext &deviceContext, cl::Kernel &kernel,
+                        FrontierBuffers &buffers, cl_uint frontierSize,
+                        std::vector<cl::Event> *events) {
+  const cl::CommandQueue &queue = deviceContext.queue;
+  const cl_uint itemsPerWorkItem = std::max<cl_uint>(1, deviceContext.config.itemsPerWorkItem);
+  kernel.setArg(4, sizeof(cl_uint), &itemsPerWorkItem);
+  kernel.setArg(7, buffers.size);
+  kernel.setArg(8, buffers.stamps);
+  const size_t localSize = std::min(
+      deviceContext.config.localSize,
+      kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(deviceContext.device));
+
+  // Cada rodada lança apenas os work-items que têm pixels da fronteira, com o
+  // total arredondado para um múltiplo do work-group.
+  cl_uint rounds = 0;
+  cl_int errorCode;
+  for (; frontierSize > 0; rounds++, buffers.round++) {
+    const cl::Buffer &frontier = buffers.frontiers[buffers.current];
+    const cl::Buffer &nextFrontier = buffers.frontiers[1 - buffers.current];
+    const cl_uint zero = 0;
+    errorCode = queue.enqueueWriteBuffer(buffers.size, CL_FALSE, 0,
+                                         sizeof(cl_uint), &zero);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+
+    kernel.setArg(2, frontier);
+    kernel.setArg(3, sizeof(cl_uint), &frontierSize);
+    kernel.setArg(6, nextFrontier);
+    kernel.setArg(9, sizeof(cl_uint), &buffers.round);
+
+    const size_t workItems =
+        (frontierSize + itemsPerWorkItem - 1) / itemsPerWorkItem;
+    cl::Event event;
+    errorCode = queue.enqueueNDRangeKernel(kernel, 0,
+                                           roundUp(workItems, localSize),
+                                           localSize, nullptr, &event);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+    if (events != nullptr)
+      events->push_back(event);
+
+    // A leitura bloqueante também espera o fim da rodada.
+    errorCode = queue.enqueueReadBuffer(buffers.size, CL_TRUE, 0,
+                                        sizeof(cl_uint), &frontierSize);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+    buffers.current = 1 - buffers.current;
+  }
+  return rounds;
+}
+
+MemoryBudget memoryBudget(const DeviceContext &deviceContext) {
+  // O restante fica para o driver, o programa e os buffers de outros usuários.
+  const double usableFraction = 0.75;
+  MemoryBudget budget;
+  budget.total = static_cast<size_t>(
+      usableFraction *
+      deviceContext.device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>());
+  budget.maxAlloc = static_cast<size_t>(
+      deviceContext.device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>());
+  if (const char *limit = std::getenv("EUCLIGPU_MEMORY_BUDGET")) {
+    budget.total =
+        std::min<size_t>(budget.total, std::strtoull(limit, nullptr, 10));
+    budget.maxAlloc = std::min(budget.maxAlloc, budget.total);
+  }
+  return budget;
+}
+
+size_t propagationFootprint(const size_t pixels, const size_t queueSize,
+                            const size_t stateSize, size_t *largestBuffer) {
+  // Os mesmos buffers de executeRounds e FrontierBuffers.
+  const size_t capacity = std::max(pixels, queueSize);
+  const size_t mask = sizeof(cl_uchar) * pixels;
+  const size_t state = stateSize * pixels;
+  const size_t frontier = sizeof(cl_uint4) * capacity;
+  const size_t stamps = sizeof(cl_uint) * pixels;
+  if (largestBuffer != nullptr)
+    *largestBuffer = std::max({mask, state, frontier, stamps});
+  return mask + state + 2 * frontier + stamps;
+}
+
+size_t tiledPixels(const cl_uint width, const cl_uint height,
+                   const cl_uint tileSize) {
+  const size_t tilesPerRow = (width + tileSize - 1) / tileSize;
+  const size_t tilesPerColumn = (height + tileSize - 1) / tileSize;
+  return tilesPerRow * tilesPerColumn * tileSize * tileSize;
+}
+
+/**
+ * \brief Se a propagação de propagationFootprint cabe no orçamento.
+*/
+static bool fitsBudget(const MemoryBudget &budget, const size_t pixels,
+                       const size_t queueSize, const size_t stateSize) {
+  size_t largest;
+  const size_t total =
+      propagationFootprint(pixels, queueSize, stateSize, &largest);
+  return total <= budget.total && largest <= budget.maxAlloc;
+}
+
+/**
+ * \brief Se o dispositivo aceita a máscara width x height num image2d_t.
+*/
+static bool supportsMaskImage(const DeviceContext &deviceContext,
+                              const cl_uint width, const cl_uint height) {
+  const cl::Device &device = deviceContext.device;
+  return device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() &&
+         width <= device.getInfo<CL_DEVICE_IMAGE2D_MAX_WIDTH>() &&
+         height <= device.getInfo<CL_DEVICE_IMAGE2D_MAX_HEIGHT>();
+}
+
+unsigned int planStripRows(const MemoryBudget &budget, const unsigned int width,
+                           const size_t stateSize) {
+  // Numa faixa, a fila inicial nunca passa do número de pixels.
+  size_t rowLargest;
+  const size_t rowTotal =
+      propagationFootprint(width, width, stateSize, &rowLargest);
+  const size_t rows =
+      std::min(budget.total / rowTotal, budget.maxAlloc / rowLargest);
+  if (rows < 3)
+    throw std::runtime_error("Not even one image row fits in the device "
+                             "memory");
+  return static_cast<unsigned int>(
+      std::min<size_t>(rows - 2, std::numeric_limits<unsigned int>::max()));
+}
+
+/**
+ * \brief Executa as rodadas de propagação de um kernel com os argumentos do
+ * euclidean: máscaras, tabela de imagens, fronteiras e um estado por pixel,
+ * com stateSize bytes por pixel, que é enviado ao dispositivo e lido de volta
+ * em state. band é o argumento da faixa, cujo tipo depende do kernel.
+ * Com um layout diferente do padrão, a imageTable tem uma só imagem. Com
+ * layout.tileSize, a máscara e o estado são convertidos no dispositivo para o
+ * layout em blocos do kernel compilado com -DTILE_SIZE, e o estado de volta no
+ * final. Com layout.maskImage, a máscara vai para um image2d_t do kernel
+ * compilado com -DMASK_IMAGE.
+*/
+template <typename Band>
+static void executeRounds(DeviceContext &deviceContext,
+                          const std::string &kernelName,
+                          const cl_uchar *masks, const size_t imageSize,
+                          const std::vector<cl_uint4> &imageTable,
+                          const std::vector<cl_uint4> &pixelQueue,
+                          void *state, const size_t stateSize, const Band band,
+                          Profiler *profiler, const std::string &defines,
+                          const DeviceLayout &layout = DeviceLayout()) {
+  const cl::Context &context = deviceContext.context;
+  const cl_uint tileSize = layout.tileSize;
+  std::string layoutDefines = defines;
+  if (tileSize > 0)
+    layoutDefines += " -DTILE_SIZE=" + std::to_string(tileSize);
+  if (layout.maskImage)
+    layoutDefines += " -DMASK_IMAGE";
+  const cl::Program &program = deviceContext.program(layoutDefines);
+  const cl::CommandQueue &queue = deviceContext.queue;
+
+  const size_t imageSizeInBytes = sizeof(cl_uchar)*imageSize;
+  cl_uint2 attrs;
+  attrs.v2[0] = imageTable[0].v4[1];
+  attrs.v2[1] = imageTable[0].v4[2];
+  // Os buffers da propagação, maiores que a imagem se os blocos da borda
+  // tiverem preenchimento.
+  const size_t storedSize =
+      tileSize == 0 ? imageSize : tiledPixels(attrs.v2[0], attrs.v2[1], tileSize);
+
+  // A máscara vai para inputBuffer ou, com layout.maskImage, para maskImage.
+  cl::Buffer inputBuffer;
+  cl::Image2D maskImage;
+  if (layout.maskImage)
+    maskImage = cl::Image2D(context, CL_MEM_READ_ONLY,
+                            cl::ImageFormat(CL_R, CL_UNSIGNED_INT8),
+                            attrs.v2[0], attrs.v2[1]);
+  else
+    inputBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                             imageSizeInBytes, nullptr);
+  cl::Buffer imageTableBuffer(context, CL_MEM_READ_ONLY,
+                              sizeof(cl_uint4)*imageTable.size(), nullptr);
+  cl::Buffer stateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                         stateSize*imageSize, nullptr);
+#ifdef EDT_STATS
+  std::vector<cl_uint> stats(STAT_COUNT, 0);
+  cl::Buffer statsBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                         sizeof(cl_uint)*stats.size(), stats.data());
+#endif
+
+  std::vector<cl::Event> uploadEvents(5);
+  // As fronteiras alternam entre as rodadas. Como um pixel entra no máximo uma
+  // vez por rodada, nenhuma passa do tamanho da imagem.
+  FrontierBuffers frontierBuffers(deviceContext, storedSize,
+                                  std::max(imageSize, pixelQueue.size()),
+                                  &uploadEvents[2]);
+  cl_int errorCode;
+  {
+    Profiler::ScopedPhase phase(profiler, "upload");
+    if (layout.maskImage) {
+      cl::size_t<3> origin, region;
+      origin[0] = origin[1] = origin[2] = 0;
+      region[0] = attrs.v2[0];
+      region[1] = attrs.v2[1];
+      region[2] = 1;
+      errorCode = queue.enqueueWriteImage(maskImage, CL_FALSE, origin, region,
+                                          attrs.v2[0], 0, masks, nullptr,
+                                          &uploadEvents[0]);
+    } else {
+      errorCode = queue.enqueueWriteBuffer(inputBuffer, CL_FALSE, 0,
+                               imageSizeInBytes, masks, nullptr, &uploadEvents[0]);
+    }
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+
+    errorCode = queue.enqueueWriteBuffer(imageTableBuffer, CL_FALSE, 0,
+                             sizeof(cl_uint4)*imageTable.size(), imageTable.data(),
+                             nullptr, &uploadEvents[4]);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+
+    errorCode = queue.enqueueWriteBuffer(frontierBuffers.frontiers[0], CL_FALSE, 0,
+                             sizeof(cl_uint4)*pixelQueue.size(), pixelQueue.data(),
+                             nullptr, &uploadEvents[1]);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+
+    errorCode = queue.enqueueWriteBuffer(stateBuffer, CL_TRUE, 0,
+                             stateSize*imageSize, state, nullptr, &uploadEvents[3]);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+  }
+
+  // No layout em blocos, inputBuffer e stateBuffer são só as cópias em ordem
+  // de linhas trocadas com o host.
+  cl::Buffer maskBuffer = inputBuffer;
+  cl::Buffer propagationState = stateBuffer;
+  std::vector<cl::Event> layoutEvents;
+  cl::Kernel convertLayout;
+  if (tileSize > 0) {
+    Profiler::ScopedPhase phase(profiler, "layout");
+    propagationState = cl::Buffer(context, CL_MEM_READ_WRITE,
+                                  stateSize*storedSize, nullptr);
+    const cl_uint words = static_cast<cl_uint>(stateSize / sizeof(cl_uint));
+    convertLayout = cl::Kernel(program, "convertLayout");
+    convertLayout.setArg(1, attrs);
+    convertLayout.setArg(2, sizeof(cl_uint), &words);
+    convertLayout.setArg(0, stateBuffer);
+    convertLayout.setArg(3, cl_uint(1));
+    convertLayout.setArg(4, propagationState);
+    std::vector<cl::Kernel> passes = {convertLayout};
+    // A máscara em image2d_t é lida por coordenadas e fica como está.
+    if (!layout.maskImage) {
+      maskBuffer = cl::Buffer(context, CL_MEM_READ_WRITE,
+                              sizeof(cl_uchar)*storedSize, nullptr);
+      cl::Kernel tileMask(program, "tileMask");
+      tileMask.setArg(0, inputBuffer);
+      tileMask.setArg(1, attrs);
+      tileMask.setArg(2, maskBuffer);
+      passes.push_back(tileMask);
+    }
+    for (const cl::Kernel &pass : passes) {
+      layoutEvents.emplace_back();
+      errorCode = queue.enqueueNDRangeKernel(pass, cl::NullRange,
+                                             cl::NDRange(imageSize),
+                                             cl::NullRange, nullptr,
+                                             &layoutEvents.back());
+      if (errorCode != CL_SUCCESS)
+        throw std::runtime_error(getErrorString(errorCode));
+    }
+  }
+
+  cl::Kernel kernel(program, kernelName.c_str());
+  if (layout.maskImage)
+    kernel.setArg(0, maskImage);
+  else
+    kernel.setArg(0, maskBuffer);
+  kernel.setArg(1, imageTableBuffer);
+  kernel.setArg(5, propagationState);
+  kernel.setArg(10, band);
+#ifdef EDT_STATS
+  kernel.setArg(11, statsBuffer);
+#endif
+
+  std::vector<cl::Event> kernelEvents;
+  [[maybe_unused]] cl_uint rounds;
+  {
+    Profiler::ScopedPhase phase(profiler, "kernel");
+    rounds = propagateRounds(deviceContext, kernel, frontierBuffers,
+                             pixelQueue.size(), &kernelEvents);
+  }
+
+  if (tileSize > 0) {
+    Profiler::ScopedPhase phase(profiler, "layout");
+    convertLayout.setArg(0, propagationState);
+    convertLayout.setArg(3, cl_uint(0));
+    convertLayout.setArg(4, stateBuffer);
+    layoutEvents.emplace_back();
+    errorCode = queue.enqueueNDRangeKernel(convertLayout, cl::NullRange,
+                                           cl::NDRange(imageSize),
+                                           cl::NullRange, nullptr,
+                                           &layoutEvents.back());
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+  }
+
+  // Retorna o resultado da computação na GPU para o dataOutput.
+  cl::Event readbackEvent;
+  {
+    Profiler::ScopedPhase phase(profiler, "readback");
+    errorCode = queue.enqueueReadBuffer(stateBuffer, CL_TRUE, 0,
+                            stateSize*imageSize, state, nullptr, &readbackEvent);
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(getErrorString(errorCode));
+  }
+
+#ifdef EDT_STATS
+  errorCode = queue.enqueueReadBuffer(statsBuffer, CL_TRUE, 0,
+                          sizeof(cl_uint)*stats.size(), stats.data());
+  if (errorCode != CL_SUCCESS)
+    throw std::runtime_error(getErrorString(errorCode));
+  printPropagationStats(stats, rounds);
+#endif
+
+  if (profiler != nullptr) {
+    for (const cl::Event &event : uploadEvents)
+      profiler->addDeviceTime("upload", getEventMs(event));
+    for (const cl::Event &event : layoutEvents)
+      profiler->addDeviceTime("layout", getEventMs(event));
+    for (const cl::Event &event : kernelEvents)
+      profiler->addDeviceTime("kernel", getEventMs(event));
+    profiler->addDeviceTime("readback", getEventMs(readbackEvent));
+  }
+}
+
+/**
+ * \brief Propaga em faixas de stripRows linhas uma imagem que não cabe inteira
+ * no dispositivo, como o IWPP distribuído: cada faixa vai com uma linha de
+ * halo acima e abaixo, e os pixels do halo que mudam entram na fronteira da
+ * faixa vizinha. As faixas com fronteira são varridas alternadamente para
+ * baixo e para cima até nenhuma ter fronteira. O ponto fixo é o da propagação
+ * inteira, porque a propagação só relaxa, em qualquer ordem.
+ * O estado de cada faixa é o próprio intervalo de linhas de state, e a
+ * entrada da imageTable leva a primeira linha da faixa em w.
+*/
+template <typename Band>
+static void executeStrips(DeviceContext &deviceContext,
+                          const std::string &kernelName,
+                          const cl_uchar *mask, const cl_uint width,
+                          const cl_uint height,
+                          const std::vector<cl_uint4> &pixelQueue,
+                          void *state, const size_t stateSize, const Band band,
+                          Profiler *profiler, const std::string &defines,
+                          const cl_uint stripRows) {
+  cl_uchar *stateBytes = static_cast<cl_uchar *>(state);
+  const size_t rowBytes = stateSize * width;
+  const cl_uint strips = (height + stripRows - 1) / stripRows;
+  std::vector<std::vector<cl_uint4>> pending(strips);
+  for (const cl_uint4 &p : pixelQueue)
+    pending[p.v4[1] / stripRows].push_back(p);
+
+  std::vector<cl_uchar> halos[2];
+  bool active = true;
+  for (bool downward = true; active; downward = !downward) {
+    active = false;
+    for (cl_uint i = 0; i < strips; i++) {
+      const cl_uint strip = downward ? i : strips - 1 - i;
+      std::vector<cl_uint4> &frontier = pending[strip];
+      if (frontier.empty())
+        continue;
+      active = true;
+
+      const cl_uint begin = strip * stripRows;
+      const cl_uint end = std::min(height, begin + stripRows);
+      const cl_uint top = begin > 0 ? begin - 1 : begin;
+      const cl_uint bottom = end < height ? end + 1 : end;
+      // Um pixel pode ter mudado no halo em várias faixas vizinhas antes
+      // desta; ele entra uma vez só, e a fila cabe na faixa.
+      std::sort(frontier.begin(), frontier.end(),
+                [](const cl_uint4 &a, const cl_uint4 &b) {
+                  return a.v4[2] < b.v4[2];
+                });
+      frontier.erase(std::unique(frontier.begin(), frontier.end(),
+                                 [](const cl_uint4 &a, const cl_uint4 &b) {
+                                   return a.v4[2] == b.v4[2];
+                                 }),
+                     frontier.end());
+      std::vector<cl_uint4> stripQueue;
+      stripQueue.reserve(frontier.size());
+      for (const cl_uint4 &p : frontier)
+        stripQueue.push_back(constructCoord(p.v4[1] - top, p.v4[0], width));
+      frontier.clear();
+
+      // Linhas de halo: a de cima, na faixa anterior, e a de baixo, na seguinte.
+      const cl_uint haloRows[2] = {top, bottom - 1};
+      const bool hasHalo[2] = {top < begin, bottom > end};
+      for (int k = 0; k < 2; k++)
+        if (hasHalo[k])
+          halos[k].assign(stateBytes + haloRows[k] * rowBytes,
+                          stateBytes + (haloRows[k] + 1) * rowBytes);
+
+      const std::vector<cl_uint4> imageTable = {{0, width, bottom - top, top}};
+      executeRounds(deviceContext, kernelName, mask + size_t(top) * width,
+                    size_t(bottom - top) * width, imageTable, stripQueue,
+                    stateBytes + top * rowBytes, stateSize, band, profiler,
+                    defines);
+
+      for (int k = 0; k < 2; k++) {
+        if (!hasHalo[k])
+          continue;
+        const cl_uchar *row = stateBytes + haloRows[k] * rowBytes;
+        std::vector<cl_uint4> &neighbor =
+            pending[k == 0 ? strip - 1 : strip + 1];
+        for (cl_uint x = 0; x < width; x++)
+          if (std::memcmp(halos[k].data() + x * stateSize, row + x * stateSize,
+                          stateSize) != 0)
+            neighbor.push_back(constructCoord(haloRows[k], x, width));
+      }
+    }
+  }
+}
+
+/**
+ * \brief executeRounds, se a propagação couber no orçamento do dispositivo.
+ * Senão, um lote é separado em imagens, e uma imagem que ainda não cabe é
+ * propagada em faixas por executeStrips. layout só é usado numa imagem sozinha
+ * que cabe inteira com ele, e a máscara em image2d_t, num dispositivo com
+ * suporte a imagens desse tamanho; lotes e faixas ficam com o layout padrão.
+*/
+template <typename Band>
+static void executePlanned(DeviceContext &deviceContext,
+                           const std::string &kernelName,
+                           const cl_uchar *masks, const size_t imageSize,
+                           const std::vector<cl_uint4> &imageTable,
+                           const std::vector<cl_uint4> &pixelQueue,
+                           void *state, const size_t stateSize,
+                           const Band band, Profiler *profiler,
+                           const std::string &defines,
+                           const DeviceLayout &layout = DeviceLayout()) {
+  const MemoryBudget budget = memoryBudget(deviceContext);
+  if ((layout.tileSize > 0 || layout.maskImage) && imageTable.size() == 1) {
+    const cl_uint4 &entry = imageTable[0];
+    DeviceLayout usable = layout;
+    usable.maskImage = layout.maskImage &&
+                       supportsMaskImage(deviceContext, entry.v4[1], entry.v4[2]);
+    // Os buffers em blocos, além das cópias da máscara e do estado em ordem de
+    // linhas.
+    size_t largest;
+    const size_t total =
+        usable.tileSize == 0
+            ? propagationFootprint(imageSize, pixelQueue.size(), stateSize,
+                                   &largest)
+            : propagationFootprint(
+                  tiledPixels(entry.v4[1], entry.v4[2], usable.tileSize),
+                  pixelQueue.size(), stateSize, &largest) +
+                  (sizeof(cl_uchar) + stateSize) * imageSize;
+    if (total <= budget.total && largest <= budget.maxAlloc) {
+      executeRounds(deviceContext, kernelName, masks, imageSize, imageTable,
+                    pixelQueue, state, stateSize, band, profiler, defines,
+                    usable);
+      return;
+    }
+  }
+  if (fitsBudget(budget, imageSize, pixelQueue.size(), stateSize)) {
+    executeRounds(deviceContext, kernelName, masks, imageSize, imageTable,
+                  pixelQueue, state, stateSize, band, profiler, defines);
+    return;
+  }
+
+  cl_uchar *stateBytes = static_cast<cl_uchar *>(state);
+  if (imageTable.size() > 1) {
+    std::vector<std::vector<cl_uint4>> queues(imageTable.size());
+    for (cl_uint4 p : pixelQueue) {
+      const cl_uint image = p.v4[3];
+      p.v4[3] = 0;
+      queues[image].push_back(p);
+    }
+    for (size_t i = 0; i < imageTable.size(); i++) {
+      if (queues[i].empty())
+        continue;
+      const cl_uint4 &entry = imageTable[i];
+      const std::vector<cl_uint4> table = {{0, entry.v4[1], entry.v4[2], 0}};
+      executePlanned(deviceContext, kernelName, masks + entry.v4[0],
+                     size_t(entry.v4[1]) * entry.v4[2], table, queues[i],
+                     stateBytes + entry.v4[0] * stateSize, stateSize, band,
+                     profiler, defines);
+    }
+    return;
+  }
+
+  const cl_uint4 &entry = imageTable[0];
+  executeStrips(deviceContext, kernelName, masks, entry.v4[1], entry.v4[2],
+                pixelQueue, state, stateSize, band, profiler, defines,
+                planStripRows(budget, entry.v4[1], stateSize));
+}
+
+void executeOpenCL(DeviceContext &deviceContext,
+                   const std::string &kernelName,
+                   const cl_uchar *masks,
+                   const std::vector<cl_uint4> &imageTable,
+                   const std::vector<cl_uint4> &pixelQueue,
+                   const VoronoiDiagramMap *voronoi,
+                   Profiler *profiler,
+                   const std::string &defines,
+                   const cl_ulong band,
+                   const DeviceLayout &layout) {
+  executePlanned(deviceContext, kernelName, masks, voronoi->sizeOfDiagram,
+                 imageTable, pixelQueue, voronoi->entries,
+                 sizeof(VoronoiDiagramMapEntry), band,
+                 profiler, defines, layout);
+}
+
+void executeGeodesic(DeviceContext &deviceContext,
+                     const cl_uchar *obstacles,
+                     const std::vector<cl_uint4> &imageTable,
+                     const std::vector<cl_uint4> &pixelQueue,
+                     std::vector<cl_uint> &costs, Profiler *profiler,
+                     const cl_uint maxCost) {
+  executePlanned(deviceContext, "geodesic", obstacles, costs.size(),
+                 imageTable, pixelQueue, costs.data(), sizeof(cl_uint), maxCost,
+                 profiler, "");
+}
+
+} // namespace OpenCLUtils
@@ -1,207 +1,253 @@
-#include <iostream>
-#include <stdexcept>
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
 
 #include "ImageUtils.hpp"
+#include "Profiling.hpp"
 
 namespace OpenCLUtils {
 
-const char *getErrorString(cl_int error)
-{
-switch(error){
-    // run-time and JIT compiler errors
-    case 0: return "CL_SUCCESS";
-    case -1: return "CL_DEVICE_NOT_FOUND";
-    case -2: return "CL_DEVICE_NOT_AVAILABLE";
-    case -3: return "CL_COMPILER_NOT_AVAILABLE";
-    case -4: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
-    case -5: return "CL_OUT_OF_RESOURCES";
-    case -6: return "CL_OUT_OF_HOST_MEMORY";
-    case -7: return "CL_PROFILING_INFO_NOT_AVAILABLE";
-    case -8: return "CL_MEM_COPY_OVERLAP";
-    case -9: return "CL_IMAGE_FORMAT_MISMATCH";
-    case -10: return "CL_IMAGE_FORMAT_NOT_SUPPORTED";
-    case -11: return "CL_BUILD_PROGRAM_FAILURE";
-    case -12: return "CL_MAP_FAILURE";
-    case -13: return "CL_MISALIGNED_SUB_BUFFER_OFFSET";
-    case -14: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
-    case -15: return "CL_COMPILE_PROGRAM_FAILURE";
-    case -16: return "CL_LINKER_NOT_AVAILABLE";
-    case -17: return "CL_LINK_PROGRAM_FAILURE";
-    case -18: return "CL_DEVICE_PARTITION_FAILED";
-    case -19: return "CL_KERNEL_ARG_INFO_NOT_AVAILABLE";
-
-    // compile-time errors
-    case -30: return "CL_INVALID_VALUE";
-    case -31: return "CL_INVALID_DEVICE_TYPE";
-    case -32: return "CL_INVALID_PLATFORM";
-    case -33: return "CL_INVALID_DEVICE";
-    case -34: return "CL_INVALID_CONTEXT";
-    case -35: return "CL_INVALID_QUEUE_PROPERTIES";
-    case -36: return "CL_INVALID_COMMAND_QUEUE";
-    case -37: return "CL_INVALID_HOST_PTR";
-    case -38: return "CL_INVALID_MEM_OBJECT";
-    case -39: return "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR";
-    case -40: return "CL_INVALID_IMAGE_SIZE";
-    case -41: return "CL_INVALID_SAMPLER";
-    case -42: return "CL_INVALID_BINARY";
-    case -43: return "CL_INVALID_BUILD_OPTIONS";
-    case -44: return "CL_INVALID_PROGRAM";
-    case -45: return "CL_INVALID_PROGRAM_EXECUTABLE";
-    case -46: return "CL_INVALID_KERNEL_NAME";
-    case -47: return "CL_INVALID_KERNEL_DEFINITION";
-    case -48: return "CL_INVALID_KERNEL";
-    case -49: return "CL_INVALID_ARG_INDEX";
-    case -50: return "CL_INVALID_ARG_VALUE";
-    case -51: return "CL_INVALID_ARG_SIZE";
-    case -52: return "CL_INVALID_KERNEL_ARGS";
-    case -53: return "CL_INVALID_WORK_DIMENSION";
-    case -54: return "CL_INVALID_WORK_GROUP_SIZE";
-    case -55: return "CL_INVALID_WORK_ITEM_SIZE";
-    case -56: return "CL_INVALID_GLOBAL_OFFSET";
-    case -57: return "CL_INVALID_EVENT_WAIT_LIST";
-    case -58: return "CL_INVALID_EVENT";
-    case -59: return "CL_INVALID_OPERATION";
-    case -60: return "CL_INVALID_GL_OBJECT";
-    case -61: return "CL_INVALID_BUFFER_SIZE";
-    case -62: return "CL_INVALID_MIP_LEVEL";
-    case -63: return "CL_INVALID_GLOBAL_WORK_SIZE";
-    case -64: return "CL_INVALID_PROPERTY";
-    case -65: return "CL_INVALID_IMAGE_DESCRIPTOR";
-    case -66: return "CL_INVALID_COMPILER_OPTIONS";
-    case -67: return "CL_INVALID_LINKER_OPTIONS";
-    case -68: return "CL_INVALID_DEVICE_PARTITION_COUNT";
-
-    // extension errors
-    case -1000: return "CL_INVALID_GL_SHAREGROUP_REFERENCE_KHR";
-    case -1001: return "CL_PLATFORM_NOT_FOUND_KHR";
-    case -1002: return "CL_INVALID_D3D10_DEVICE_KHR";
-    case -1003: return "CL_INVALID_D3D10_RESOURCE_KHR";
-    case -1004: return "CL_D3D10_RESOURCE_ALREADY_ACQUIRED_KHR";
-    case -1005: return "CL_D3D10_RESOURCE_NOT_ACQUIRED_KHR";
-    default: return "Unknown OpenCL error";
-    }
-}
-
-std::vector<cl::Device> getDevices() {
-  std::vector<cl::Platform> platforms;
-  cl::Platform::get(&platforms);
-
-  if (platforms.size() == 0) {
-    throw std::runtime_error(
-        "There is no platforms available. Check OpenCL installation!");
-  }
-
-  cl::Platform defaultPlatform = platforms[1];
-  std::cout << "Using platform: " << defaultPlatform.getInfo<CL_PLATFORM_NAME>()
-            << "\n";
-
-  std::vector<cl::Device> devices;
-  defaultPlatform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
-  if (devices.size() == 0) {
-    throw std::runtime_error(
-        "There is no devices available. Check OpenCL installation!");
-  }
-
-  return devices;
-}
-
-cl::Device getDevice(int deviceId) {
-  std::vector<cl::Device> devices(getDevices());
-
-  if (deviceId > static_cast<int>(devices.size())) {
-    throw std::runtime_error("There is just " + std::to_string(devices.size()) +
-                             " devices available, so there is no device id " +
-                             std::to_string(deviceId));
-  }
-
-  const cl::Device device = devices[deviceId];
-  std::cout << "Using device: " << device.getInfo<CL_DEVICE_NAME>() << "\n";
-  return device;
-}
-
-cl::Device userSelectDevice() {
-  std::vector<cl::Device> devices(getDevices());
-
-  for (std::size_t i = 0; i < devices.size(); ++i) {
-    std::cout << "Device " << i << " - " << devices[i].getInfo<CL_DEVICE_NAME>()
-              << std::endl;
-  }
-
-  std::cout << "Select your device id: ";
-  int deviceId;
-  std::cin >> deviceId;
-  cl::Device defaultDevice = devices[deviceId];
-  std::cout << "Using device: " << defaultDevice.getInfo<CL_DEVICE_NAME>()
-            << "\n";
-
-  return defaultDevice;
-}
-
+const char *getErrorString(cl_int error);
+
+/**
+ * \brief Lista os dispositivos de todas as plataformas OpenCL.
+*/
+std::vector<cl::Device> getDevices();
+
+cl::Device getDevice(int deviceId);
+
+cl::Device userSelectDevice();
+
+#ifdef EDT_STATS
+/**
+ * \brief Contadores acumulados pelo kernel quando compilado com -DEDT_STATS, na
+ * mesma ordem dos índices STAT_* do kernel.cl.
+*/
+enum PropagationStat {
+  STAT_PIXELS,
+  STAT_UPDATES,
+  STAT_CAS_RETRIES,
+  STAT_QUEUE_OVERFLOWS,
+  STAT_COUNT
+};
+
+void printPropagationStats(const std::vector<cl_uint> &stats,
+                           const cl_uint rounds);
+#endif
+
+/**
+ * \brief Converte o intervalo entre o início e o fim de um evento em
+ * milissegundos. Requer uma fila criada com CL_QUEUE_PROFILING_ENABLE.
+*/
+double getEventMs(const cl::Event &event);
+
+/**
+ * \brief Geometria de lançamento do kernel, ajustável por dispositivo pelo
+ * autotuner.
+*/
+struct LaunchConfig {
+  // Tamanho do work-group.
+  size_t localSize = 32;
+  // Quantos pixels da fronteira de cada rodada cada work-item processa.
+  cl_uint itemsPerWorkItem = 1;
+  // Capacidade da fila circular privada, fixada na compilação do kernel.
+  cl_uint queueCapacity = 64;
+};
+
+/**
+ * \brief Dispositivo pronto para executar: contexto, programa compilado e fila
+ * de comandos. Criar um é caro (compila o kernel), então ele deve ser
+ * reutilizado entre imagens. Não deve ser usado por duas threads ao mesmo tempo.
+*/
+class DeviceContext {
+public:
+  /**
+   * \brief Usa a configuração padrão. A do perfil do dispositivo vem de
+   * Autotuner::loadProfile, só quando o chamador pede.
+  */
+  DeviceContext(const cl::Device &device, const std::string &kernelSource);
+  DeviceContext(const cl::Device &device, const std::string &kernelSource,
+                const LaunchConfig &config);
+
+  std::string name() const;
+
+  /**
+   * \brief Programa compilado com as opções -D extras defines. Cada variante é
+   * compilada no primeiro uso e mantida para as execuções seguintes.
+  */
+  const cl::Program &program(const std::string &defines = "");
+
+  const cl::Device device;
+  // A capacidade da fila já foi compilada no programa; só o tamanho do
+  // work-group e os pixels por work-item podem mudar depois da construção.
+  LaunchConfig config;
+  cl::Context context;
+  cl::CommandQueue queue;
+
+private:
+  const std::string m_kernelSource;
+  std::map<std::string, cl::Program> m_programs;
+};
+
+/**
+ * \brief Fronteiras da propagação em rodadas e os carimbos que evitam
+ * duplicatas nelas. Podem ficar no dispositivo entre propagações sobre o mesmo
+ * estado, como os quadros de um vídeo.
+*/
+struct FrontierBuffers {
+  /**
+   * \brief Zera os carimbos dos imageSize pixels; cada fronteira comporta
+   * capacity pixels.
+  */
+  FrontierBuffers(DeviceContext &deviceContext, const size_t imageSize,
+                  const size_t capacity, cl::Event *fillEvent = nullptr);
+
+  // A fronteira da rodada atual é frontiers[current]; a outra recebe a próxima.
+  cl::Buffer frontiers[2];
+  cl::Buffer size;
+  cl::Buffer stamps;
+  int current = 0;
+  // Os carimbos só são zerados na criação, então a contagem das rodadas
+  // continua de uma propagação para a seguinte. Começa em 1 pelo mesmo motivo.
+  cl_uint round = 1;
+};
+
+/**
+ * \brief Lança rodadas de kernel a partir dos frontierSize pixels de
+ * buffers.frontiers[buffers.current] até a fronteira esvaziar. O kernel tem os
+ * argumentos do euclidean, e só os de fronteira são definidos aqui; a faixa,
+ * o argumento 10, fica com quem chama. Retorna o
+ * número de rodadas; o evento de cada uma vai para events, se não for nulo.
+*/
+cl_uint propagateRounds(DeviceContext &deviceContext, cl::Kernel &kernel,
+                        FrontierBuffers &buffers, cl_uint frontierSize,
+                        std::vector<cl::Event> *events = nullptr);
+
+/**
+ * \brief Memória de dispositivo disponível para uma propagação: uma fração de
+ * CL_DEVICE_GLOBAL_MEM_SIZE, que deixa espaço para o driver e os demais
+ * buffers, limitada por $EUCLIGPU_MEMORY_BUDGET, em bytes, se definida. Nenhum
+ * buffer isolado passa de maxAlloc, o CL_DEVICE_MAX_MEM_ALLOC_SIZE.
+*/
+struct MemoryBudget {
+  size_t total;
+  size_t maxAlloc;
+};
+
+MemoryBudget memoryBudget(const DeviceContext &deviceContext);
+
+/**
+ * \brief Memória de dispositivo de executeOpenCL ou executeGeodesic sobre
+ * pixels pixels, com queueSize pixels na fila inicial e stateSize bytes de
+ * estado por pixel: máscara, estado, as duas fronteiras e os carimbos.
+ * largestBuffer, se não for nulo, recebe o tamanho do maior deles.
+*/
+size_t propagationFootprint(const size_t pixels, const size_t queueSize,
+                            const size_t stateSize,
+                            size_t *largestBuffer = nullptr);
+
+/**
+ * \brief Como a propagação de executeOpenCL guarda uma imagem no dispositivo.
+ * O padrão é a ordem de linhas em buffers, como no host.
+*/
+struct DeviceLayout {
+  // Com n diferente de 0, a máscara e o diagrama ficam em blocos de n x n
+  // pixels, e os vizinhos de cima e de baixo de um pixel, perto dele na
+  // memória.
+  unsigned int tileSize = 0;
+  // A máscara vai para um image2d_t, se o dispositivo tiver suporte a imagens;
+  // senão, fica no buffer. A propagação lê por ela, com um sampler
+  // clamp-to-edge, os vizinhos de fundo, que não relaxa.
+  bool maskImage = false;
+};
+
+/**
+ * \brief Pixels de uma imagem width x height guardada em blocos de tileSize x
+ * tileSize, com os blocos da borda completos.
+*/
+size_t tiledPixels(const cl_uint width, const cl_uint height,
+                   const cl_uint tileSize);
+
+/**
+ * \brief Quantas linhas de uma imagem com width colunas cabem numa faixa
+ * propagada sozinha no orçamento, sem contar as duas linhas de halo. Lança
+ * std::runtime_error se nem uma linha couber.
+*/
+unsigned int planStripRows(const MemoryBudget &budget, const unsigned int width,
+                           const size_t stateSize);
+
+/**
+ * \brief Executa a propagação em um contexto criado apenas para esta execução,
+ * no primeiro dispositivo. defines são opções -D extras da compilação do
+ * kernel, que escolhem a variante executada, como a métrica. A propagação
+ * para em band, de Metrics::bandLimit na escala da métrica, e os pixels mais
+ * distantes ficam com a coordenada inválida.
+*/
 void executeOpenCL(const std::string &kernelName,
                    const std::string &kernelSource,
                    const UCImage *image,
                    const std::vector<cl_uint4>& pixelQueue,
-                   const VoronoiDiagramMap *voronoi) {
-
-  const cl::Device defaultDevice = getDevice(0);
-
-  cl::Context context({defaultDevice});
-  cl::Program::Sources sources;
-
-  sources.push_back({kernelSource.c_str(), kernelSource.length()});
-  cl::Program program(context, sources);
-  if (program.build({defaultDevice}) != CL_SUCCESS) {
-    throw std::runtime_error(
-        "Error building: " +
-        program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(defaultDevice));
-  }
-
-  const size_t imageSize = image->attrs.v2[0]*image->attrs.v2[1];
-  const size_t imageSizeInBytes = sizeof(cl_uchar)*imageSize;
-
-  cl::Buffer inputBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
-                         imageSizeInBytes, nullptr);
-  cl::Buffer inputQueueBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
-                         sizeof(cl_uint4)*pixelQueue.size(), nullptr);
-  cl::Buffer outputVoronoiBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
-                         sizeof(VoronoiDiagramMapEntry)*voronoi->sizeOfDiagram, nullptr);
-
-  cl::CommandQueue queue(context, defaultDevice);
-  
-  cl_int errorCode = queue.enqueueWriteBuffer(inputBuffer, CL_TRUE, 0,
-                           imageSizeInBytes, image->image);
-  if (errorCode != CL_SUCCESS)
-    throw std::runtime_error(getErrorString(errorCode));
-
-  errorCode = queue.enqueueWriteBuffer(inputQueueBuffer, CL_FALSE, 0,
-                           sizeof(cl_uint4)*pixelQueue.size(), pixelQueue.data());
-  if (errorCode != CL_SUCCESS)
-    throw std::runtime_error(getErrorString(errorCode));
-
-  errorCode = queue.enqueueWriteBuffer(outputVoronoiBuffer, CL_TRUE, 0,
-                           sizeof(VoronoiDiagramMapEntry)*voronoi->sizeOfDiagram, voronoi->entries);
-  if (errorCode != CL_SUCCESS)
-    throw std::runtime_error(getErrorString(errorCode));
-  
-  const int localSize = 32;
-  const unsigned int pixelQueueSize = pixelQueue.size();
-  cl::Kernel kernel(program, kernelName.c_str());
-  kernel.setArg(0, inputBuffer);
-  kernel.setArg(1, sizeof(cl_uint2), &image->attrs);
-  kernel.setArg(2, inputQueueBuffer);
-  kernel.setArg(3, sizeof(unsigned int), &pixelQueueSize);
-  kernel.setArg(4, outputVoronoiBuffer);
-  kernel.setArg(5, sizeof(unsigned int), &voronoi->sizeOfDiagram);
-
-  errorCode = queue.enqueueNDRangeKernel(kernel, 0, imageSize, localSize);
-  if (errorCode != CL_SUCCESS)
-    throw std::runtime_error(getErrorString(errorCode));
-
-  // Retorna o resultado da computação na GPU para o dataOutput.
-  errorCode = queue.enqueueReadBuffer(outputVoronoiBuffer, CL_TRUE, 0,
-                          sizeof(VoronoiDiagramMapEntry) * voronoi->sizeOfDiagram, voronoi->entries);
-  if (errorCode != CL_SUCCESS)
-    throw std::runtime_error(getErrorString(errorCode));
-}
-
-} // namespace OpenCLUtils
\ No newline at end of file
+                   const VoronoiDiagramMap *voronoi,
+                   Profiler *profiler = nullptr,
+                   const std::string &defines = "",
+                   const cl_ulong band = ULONG_MAX,
+                   const DeviceLayout &layout = DeviceLayout());
+
+/**
+ * \brief Executa a propagação em um contexto já preparado. Se a imagem não
+ * couber no orçamento do dispositivo, ela é propagada em faixas de linhas, uma
+ * de cada vez, com o mesmo resultado. layout escolhe como a máscara e o
+ * diagrama ficam no dispositivo durante a propagação, também com o mesmo
+ * resultado.
+*/
+void executeOpenCL(DeviceContext &deviceContext,
+                   const std::string &kernelName,
+                   const UCImage *image,
+                   const std::vector<cl_uint4>& pixelQueue,
+                   const VoronoiDiagramMap *voronoi,
+                   Profiler *profiler = nullptr,
+                   const std::string &defines = "",
+                   const cl_ulong band = ULONG_MAX,
+                   const DeviceLayout &layout = DeviceLayout());
+
+/**
+ * \brief Executa a propagação de várias imagens num único lançamento por
+ * rodada. As máscaras e os diagramas de Voronoi estão concatenados em masks e
+ * voronoi, ambos com voronoi->sizeOfDiagram pixels. A entrada i da imageTable
+ * tem o deslocamento da imagem i em x e a largura e a altura em y e z. Cada
+ * pixel da pixelQueue tem coordenadas relativas à sua imagem e o índice dela em w.
+ * Um lote que não cabe no orçamento do dispositivo é propagado imagem por
+ * imagem, e cada uma, se preciso, em faixas. layout só vale para um lote de
+ * uma imagem.
+*/
+void executeOpenCL(DeviceContext &deviceContext,
+                   const std::string &kernelName,
+                   const cl_uchar *masks,
+                   const std::vector<cl_uint4> &imageTable,
+                   const std::vector<cl_uint4> &pixelQueue,
+                   const VoronoiDiagramMap *voronoi,
+                   Profiler *profiler = nullptr,
+                   const std::string &defines = "",
+                   const cl_ulong band = ULONG_MAX,
+                   const DeviceLayout &layout = DeviceLayout());
+
+/**
+ * \brief Executa a distância geodésica com o kernel geodesic, nas mesmas
+ * rodadas e com a mesma imageTable de executeOpenCL. obstacles tem valor 0 nos
+ * pixels livres. costs tem o custo acumulado de cada pixel em ponto fixo, 0 nas
+ * sementes e UINT_MAX nos demais, e recebe os custos propagados, sem passar
+ * de maxCost. Cabe no dispositivo como executeOpenCL.
+*/
+void executeGeodesic(DeviceContext &deviceContext,
+                     const cl_uchar *obstacles,
+                     const std::vector<cl_uint4> &imageTable,
+                     const std::vector<cl_uint4> &pixelQueue,
+                     std::vector<cl_uint> &costs,
+                     Profiler *profiler = nullptr,
+                     const cl_uint maxCost = UINT_MAX);
+
+} // namespace OpenCLUtils
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Registra o tempo gasto em cada fase de uma execução, tanto medido no
+ * host quanto medido pelos eventos do OpenCL no dispositivo.
+*/
+class Profiler {
+public:
+  enum class Format { Text, JSON };
+
+  struct Phase {
+    std::string name;
+    // Tempo em milissegundos.
+    double hostMs;
+    // Tempo medido pelos eventos do dispositivo, negativo quando não há evento.
+    double deviceMs;
+  };
+
+  /**
+   * \brief Mede o tempo de host de um escopo e o registra como uma fase ao ser
+   * destruído.
+  */
+  class ScopedPhase {
+  public:
+    ScopedPhase(Profiler *profiler, const std::string &name)
+        : m_profiler(profiler), m_name(name),
+          m_start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedPhase() { stop(); }
+
+    /**
+     * \brief Encerra a fase antes do fim do escopo, útil quando os objetos
+     * criados na fase precisam sobreviver a ela.
+    */
+    void stop() {
+      if (m_profiler == nullptr)
+        return;
+      const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - m_start;
+      m_profiler->addHostTime(m_name, elapsed.count());
+      m_profiler = nullptr;
+    }
+
+  private:
+    Profiler *m_profiler;
+    const std::string m_name;
+    const std::chrono::steady_clock::time_point m_start;
+  };
+
+  void addHostTime(const std::string &name, const double ms) {
+    getPhase(name).hostMs += ms;
+  }
+
+  void addDeviceTime(const std::string &name, const double ms) {
+    Phase &phase = getPhase(name);
+    phase.deviceMs = (phase.deviceMs < 0 ? 0 : phase.deviceMs) + ms;
+  }
+
+  const std::vector<Phase> &phases() const { return m_phases; }
+
+  double totalHostMs() const {
+    double total = 0;
+    for (const Phase &phase : m_phases)
+      total += phase.hostMs;
+    return total;
+  }
+
+  void print(std::ostream &out, const Format format) const {
+    if (format == Format::JSON)
+      printJSON(out);
+    else
+      printText(out);
+  }
+
+  void printText(std::ostream &out) const {
+    const double total = totalHostMs();
+    out << std::left << std::setw(12) << "phase" << std::right << std::setw(12)
+        << "host ms" << std::setw(12) << "device ms" << std::setw(8) << "%"
+        << "\n";
+    for (const Phase &phase : m_phases) {
+      out << std::left << std::setw(12) << phase.name << std::right
+          << std::fixed << std::setprecision(3) << std::setw(12) << phase.hostMs;
+      if (phase.deviceMs < 0)
+        out << std::setw(12) << "-";
+      else
+        out << std::setw(12) << phase.deviceMs;
+      out << std::setprecision(1) << std::setw(8)
+          << (total > 0 ? 100 * phase.hostMs / total : 0) << "\n";
+    }
+    out << std::left << std::setw(12) << "total" << std::right
+        << std::setprecision(3) << std::setw(12) << total << "\n";
+    out.unsetf(std::ios::floatfield);
+  }
+
+  void printJSON(std::ostream &out) const {
+    out << "{\"phases\":[";
+    for (std::size_t i = 0; i < m_phases.size(); ++i) {
+      const Phase &phase = m_phases[i];
+      out << (i == 0 ? "" : ",") << "{\"name\":\"" << phase.name
+          << "\",\"host_ms\":" << phase.hostMs;
+      if (phase.deviceMs >= 0)
+        out << ",\"device_ms\":" << phase.deviceMs;
+      out << "}";
+    }
+    out << "],\"total_ms\":" << totalHostMs() << "}\n";
+  }
+
+private:
+  // As fases são mantidas na ordem em que aparecem pela primeira vez.
+  std::vector<Phase> m_phases;
+
+  Phase &getPhase(const std::string &name) {
+    for (Phase &phase : m_phases)
+      if (phase.name == name)
+        return phase;
+    m_phases.push_back(Phase{name, 0, -1});
+    return m_phases.back();
+  }
+};
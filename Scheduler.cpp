@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <ostream>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "Autotuner.hpp"
+#include "BufferPool.hpp"
+#include "Engines.hpp"
+#include "Scheduler.hpp"
+
+namespace EucliGPU {
+
+using Clock = std::chrono::steady_clock;
+
+struct Scheduler::Impl {
+  // Limite de pixels de um pacote de máscaras propagado num único lançamento.
+  // Uma máscara maior que isso vai sozinha.
+  static constexpr double packPixels = 4 * 1024 * 1024;
+
+  struct Device {
+    std::unique_ptr<OpenCLUtils::DeviceContext> context;
+    // Vazão em pixels por milissegundo, média móvel exponencial das execuções.
+    double throughput = 0;
+    // Instante estimado em que o dispositivo termina o que está executando.
+    Clock::time_point busyUntil;
+  };
+
+  std::vector<Device> devices;
+  // Compartilhado pelos dispositivos; entre lotes, os diagramas e as máscaras
+  // empacotadas reaproveitam os blocos dos lotes anteriores.
+  BufferPool buffers;
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  /**
+   * \brief Um dispositivo livre só pega a próxima máscara se nenhum outro,
+   * mesmo terminando o que está executando antes, a concluiria mais cedo.
+   * Dispositivos sem medição ainda pegam qualquer máscara para se calibrar.
+  */
+  bool shouldTake(const size_t self, const double pixels,
+                  const Clock::time_point now) const {
+    if (devices[self].throughput == 0)
+      return true;
+
+    const double selfFinish = pixels / devices[self].throughput;
+    for (size_t i = 0; i < devices.size(); i++) {
+      if (i == self || devices[i].throughput == 0)
+        continue;
+      const std::chrono::duration<double, std::milli> wait =
+          std::max(now, devices[i].busyUntil) - now;
+      if (wait.count() + pixels / devices[i].throughput < selfFinish)
+        return false;
+    }
+    return true;
+  }
+
+  void work(const size_t self, const std::vector<BatchItem> &items,
+            const Metric metric, const float maxDistance,
+            const std::vector<size_t> &order, size_t &next,
+            std::exception_ptr &error) {
+    Device &device = devices[self];
+    Options options;
+    options.metric = metric;
+    options.maxDistance = maxDistance;
+    options.buffers = &buffers;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (next < order.size() && !error) {
+      // As máscaras seguintes são agrupadas num único lançamento até somarem
+      // packPixels, o que só acontece com as pequenas do fim da ordem.
+      std::vector<BatchItem> pack;
+      double pixels = 0;
+      for (size_t i = next; i < order.size(); i++) {
+        const BatchItem &item = items[order[i]];
+        const double itemPixels = static_cast<double>(item.width) * item.height;
+        if (!pack.empty() && pixels + itemPixels > packPixels)
+          break;
+        pack.push_back(item);
+        pixels += itemPixels;
+      }
+      const Clock::time_point now = Clock::now();
+      if (!shouldTake(self, pixels, now)) {
+        // O tempo de espera limita o erro de uma estimativa de término otimista.
+        changed.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+      next += pack.size();
+      if (device.throughput > 0)
+        device.busyUntil =
+            now + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double, std::milli>(
+                          pixels / device.throughput));
+      lock.unlock();
+
+      const Clock::time_point start = Clock::now();
+      try {
+        computeDistanceTransformBatch(options, pack, device.context.get());
+      } catch (...) {
+        lock.lock();
+        if (!error)
+          error = std::current_exception();
+        changed.notify_all();
+        return;
+      }
+      const std::chrono::duration<double, std::milli> elapsed =
+          Clock::now() - start;
+
+      lock.lock();
+      const double measured = pixels / std::max(elapsed.count(), 1e-3);
+      device.throughput = device.throughput == 0
+                              ? measured
+                              : 0.7 * device.throughput + 0.3 * measured;
+      device.busyUntil = Clock::now();
+      changed.notify_all();
+    }
+  }
+};
+
+Scheduler::Scheduler(const DeviceOptions &deviceOptions) : m_impl(new Impl()) {
+  std::ostream *log = deviceOptions.log;
+  for (const cl::Device &device : OpenCLUtils::getDevices()) {
+    Impl::Device entry;
+    try {
+      entry.context.reset(new OpenCLUtils::DeviceContext(
+          device, kernelSource(),
+          deviceOptions.loadProfile ? Autotuner::loadProfile(device)
+                                    : OpenCLUtils::LaunchConfig()));
+    } catch (const std::runtime_error &e) {
+      // Um dispositivo que não compila o kernel não impede o uso dos demais.
+      if (log != nullptr)
+        *log << "Skipping device " << device.getInfo<CL_DEVICE_NAME>() << ": "
+             << e.what() << "\n";
+      continue;
+    }
+    if (log != nullptr)
+      *log << "Using device: " << entry.context->name() << "\n";
+    m_impl->devices.push_back(std::move(entry));
+  }
+  if (m_impl->devices.empty())
+    throw std::runtime_error("No OpenCL device could build the kernel");
+}
+
+Scheduler::~Scheduler() = default;
+
+size_t Scheduler::deviceCount() const { return m_impl->devices.size(); }
+
+std::vector<std::string> Scheduler::deviceNames() const {
+  std::vector<std::string> names;
+  for (const Impl::Device &device : m_impl->devices)
+    names.push_back(device.context->name());
+  return names;
+}
+
+std::vector<double> Scheduler::throughputs() const {
+  std::lock_guard<std::mutex> lock(m_impl->mutex);
+  std::vector<double> throughputs;
+  // Pixels por milissegundo equivalem a milhares de pixels por segundo.
+  for (const Impl::Device &device : m_impl->devices)
+    throughputs.push_back(device.throughput / 1e3);
+  return throughputs;
+}
+
+void Scheduler::trimBuffers() { m_impl->buffers.trim(); }
+
+void Scheduler::run(const std::vector<BatchItem> &items, const Metric metric,
+                    const float maxDistance) {
+  // As maiores máscaras primeiro, para que o fim do lote tenha apenas
+  // máscaras pequenas e os dispositivos terminem juntos.
+  std::vector<size_t> order;
+  for (size_t i = 0; i < items.size(); i++)
+    if (items[i].width != 0 && items[i].height != 0)
+      order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&items](size_t a, size_t b) {
+    return static_cast<size_t>(items[a].width) * items[a].height >
+           static_cast<size_t>(items[b].width) * items[b].height;
+  });
+
+  size_t next = 0;
+  std::exception_ptr error;
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < m_impl->devices.size(); i++)
+    workers.emplace_back(&Impl::work, m_impl.get(), i, std::cref(items), metric,
+                         maxDistance, std::cref(order), std::ref(next),
+                         std::ref(error));
+  for (std::thread &worker : workers)
+    worker.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace EucliGPU
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Context.hpp"
+#include "DistanceTransform.hpp"
+
+/**
+ * \brief Distribui lotes de máscaras entre todos os dispositivos OpenCL.
+*/
+namespace EucliGPU {
+
+/**
+ * \brief Mantém um contexto pronto (kernel compilado) por dispositivo de todas
+ * as plataformas e executa cada máscara no dispositivo que terminaria antes,
+ * estimado pela vazão medida nas execuções anteriores.
+*/
+class Scheduler {
+public:
+  /**
+   * \brief deviceOptions vale para todos os dispositivos.
+  */
+  explicit Scheduler(const DeviceOptions &deviceOptions = DeviceOptions());
+  ~Scheduler();
+
+  size_t deviceCount() const;
+  std::vector<std::string> deviceNames() const;
+
+  /**
+   * \brief Vazão medida de cada dispositivo, em megapixels por segundo, zero
+   * enquanto o dispositivo não tiver executado nada.
+  */
+  std::vector<double> throughputs() const;
+
+  /**
+   * \brief Libera os buffers do host guardados dos lotes anteriores. Não pode
+   * ser chamado durante run.
+  */
+  void trimBuffers();
+
+  /**
+   * \brief Processa todo o lote e só retorna quando todas as saídas estiverem
+   * escritas, com a métrica e a faixa de Options. O primeiro erro de qualquer
+   * dispositivo é relançado.
+  */
+  void run(const std::vector<BatchItem> &items,
+           const Metric metric = Metric::Euclidean,
+           const float maxDistance = INFINITY);
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace EucliGPU
@@ -0,0 +1,117 @@
+#include <stdexcept>
+
+#include "DeviceTransform.hpp"
+#include "Engines.hpp"
+#include "Profiling.hpp"
+#include "Skeleton.hpp"
+
+namespace EucliGPU {
+
+namespace {
+
+/**
+ * \brief O mesmo critério do kernel skeleton, para o pixel i do diagrama.
+*/
+bool isSkeleton(const UCImage *image, const VoronoiDiagramMap *voronoi,
+                const size_t i, const float minFeatureDistance) {
+  const long long width = image->attrs.v2[0];
+  const long long height = image->attrs.v2[1];
+  const cl_uint4 fp = voronoi->entries[i].nearestBackground;
+  if (image->image[i] == 0 || fp.v4[0] == UINT_MAX)
+    return false;
+
+  const long long px = i % width, py = i / width;
+  const int offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+  for (const auto &offset : offsets) {
+    const long long qx = px + offset[0], qy = py + offset[1];
+    if (qx < 0 || qy < 0 || qx >= width || qy >= height)
+      continue;
+    const cl_uint4 fq = voronoi->entries[qy * width + qx].nearestBackground;
+    if (fq.v4[0] == UINT_MAX)
+      continue;
+
+    const long long dx = static_cast<long long>(fp.v4[0]) - fq.v4[0];
+    const long long dy = static_cast<long long>(fp.v4[1]) - fq.v4[1];
+    if (static_cast<float>(dx * dx + dy * dy) <=
+        minFeatureDistance * minFeatureDistance)
+      continue;
+    const long long crit =
+        dx * (static_cast<long long>(fp.v4[0]) + fq.v4[0] - px - qx) +
+        dy * (static_cast<long long>(fp.v4[1]) + fq.v4[1] - py - qy);
+    if (crit >= 0)
+      return true;
+  }
+  return false;
+}
+
+void deviceSkeleton(const uint8_t *mask, const cl_uint2 attrs,
+                    const float minFeatureDistance, const Options &options,
+                    float *output) {
+  Profiler::ScopedPhase setupPhase(options.profiler, "setup");
+  DeviceTransform transform(attrs.v2[0], attrs.v2[1], options);
+  cl::Buffer outputBuffer(transform.deviceContext.context,
+                          CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                          sizeof(cl_float) * transform.size(), nullptr);
+  cl::Kernel skeleton(transform.program, "skeleton");
+  skeleton.setArg(1, transform.voronoi);
+  skeleton.setArg(2, attrs);
+  skeleton.setArg(3, cl_float(minFeatureDistance));
+  skeleton.setArg(4, outputBuffer);
+  setupPhase.stop();
+
+  const cl::Buffer maskBuffer = transform.upload(mask);
+  transform.propagate(maskBuffer, options.maxDistance);
+  skeleton.setArg(0, maskBuffer);
+  transform.runPerPixel(skeleton);
+  transform.readback(outputBuffer, sizeof(cl_float) * transform.size(),
+                     output);
+  transform.report();
+}
+
+void hostSkeleton(const uint8_t *mask, const cl_uint2 attrs,
+                  const float minFeatureDistance, const Options &options,
+                  float *output) {
+  const size_t size = static_cast<size_t>(attrs.v2[0]) * attrs.v2[1];
+  // A imagem só é lida, o const_cast apenas adapta ao tipo do UCImage.
+  const UCImage image =
+      constructUCImage(const_cast<uint8_t *>(mask), attrs.v2[1], attrs.v2[0]);
+  std::vector<VoronoiDiagramMapEntry> entries(size);
+  VoronoiDiagramMap voronoi;
+  voronoi.sizeOfDiagram = size;
+  voronoi.entries = entries.data();
+  std::vector<cl_uint4> queue;
+  initVoronoi(&image, &voronoi, &queue);
+  propagateCPU(&image, queue, &voronoi, options.metric, nullptr,
+               options.maxDistance);
+
+  computeDistances(&image, &voronoi, output, options.metric,
+                   options.maxDistance);
+  for (size_t i = 0; i < size; i++)
+    if (!isSkeleton(&image, &voronoi, i, minFeatureDistance))
+      output[i] = 0;
+}
+
+} // namespace
+
+void computeSkeleton(const uint8_t *mask, const unsigned int width,
+                     const unsigned int height, const float minFeatureDistance,
+                     const Options &options, float *output) {
+  if (mask == nullptr || output == nullptr)
+    throw std::runtime_error("The mask and output buffers must not be null");
+  if (options.engine == Engine::Exact || options.obstacles != nullptr)
+    throw std::runtime_error("The skeleton only supports the opencl and cpu "
+                             "engines, without obstacles");
+  checkMaxDistance(options.maxDistance);
+  if (width == 0 || height == 0)
+    return;
+
+  cl_uint2 attrs;
+  attrs.v2[0] = width;
+  attrs.v2[1] = height;
+  if (options.engine == Engine::OpenCL)
+    deviceSkeleton(mask, attrs, minFeatureDistance, options, output);
+  else
+    hostSkeleton(mask, attrs, minFeatureDistance, options, output);
+}
+
+} // namespace EucliGPU
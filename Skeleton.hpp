@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+#include "DistanceTransform.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Esqueleto (eixo medial) da máscara, tirado do diagrama de Voronoi da
+ * transformada: um pixel de objeto é do esqueleto quando ele e um vizinho de 4
+ * têm fundos mais próximos a mais de minFeatureDistance um do outro, e ele
+ * está do lado da mediatriz desses fundos. Um minFeatureDistance maior poda os
+ * ramos criados por irregularidades pequenas do contorno.
+ * output recebe, em ordem de linhas, a distância ao fundo nos pixels do
+ * esqueleto, na métrica de options, e 0 nos demais.
+ * Com a engine OpenCL o critério é aplicado por um kernel logo depois da
+ * propagação, e só output é lida de volta. A engine CPU aplica o mesmo
+ * critério no host; a Exact não calcula o diagrama e não é suportada, nem os
+ * obstáculos. Pixels além de options.maxDistance não entram no esqueleto.
+*/
+void computeSkeleton(const uint8_t *mask, const unsigned int width,
+                     const unsigned int height, const float minFeatureDistance,
+                     const Options &options, float *output);
+
+} // namespace EucliGPU
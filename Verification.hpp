@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+/**
+ * \brief Resultado da comparação de um mapa de distâncias com a referência.
+*/
+struct Comparison {
+  float maxError;
+  size_t mismatches;
+  // Índices dos primeiros pixels divergentes, limitados para não crescer com a
+  // imagem.
+  std::vector<size_t> mismatchedPixels;
+
+  bool matches() const { return mismatches == 0; }
+};
+
+/**
+ * \brief Compara pixel a pixel, considerando divergente todo pixel com erro
+ * acima da tolerância. Infinitos só são iguais a infinitos.
+*/
+inline Comparison compareDistances(const float *expected, const float *actual,
+                                   const size_t size, const float tolerance,
+                                   const size_t maxReported = 16) {
+  Comparison comparison{0, 0, {}};
+  for (size_t i = 0; i < size; i++) {
+    float error;
+    if (std::isinf(expected[i]) || std::isinf(actual[i]))
+      error = expected[i] == actual[i] ? 0 : INFINITY;
+    else
+      error = std::fabs(expected[i] - actual[i]);
+
+    if (error > comparison.maxError)
+      comparison.maxError = error;
+    if (error > tolerance) {
+      if (comparison.mismatchedPixels.size() < maxReported)
+        comparison.mismatchedPixels.push_back(i);
+      comparison.mismatches++;
+    }
+  }
+  return comparison;
+}
+
+inline void printMismatches(std::ostream &out, const Comparison &comparison,
+                            const float *expected, const float *actual,
+                            const unsigned int width) {
+  for (const size_t i : comparison.mismatchedPixels)
+    out << "  (" << i % width << ", " << i / width << "): expected "
+        << expected[i] << ", got " << actual[i] << "\n";
+  if (comparison.mismatches > comparison.mismatchedPixels.size())
+    out << "  ... and "
+        << comparison.mismatches - comparison.mismatchedPixels.size()
+        << " more\n";
+}
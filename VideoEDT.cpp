@@ -0,0 +1,194 @@
+#include <stdexcept>
+#include <utility>
+
+#include "Context.hpp"
+#include "Engines.hpp"
+#include "Metrics.hpp"
+#include "VideoEDT.hpp"
+
+namespace EucliGPU {
+
+struct VideoEDT::Impl {
+  Options options;
+  cl_uint2 attrs;
+  // O de Options::context ou, sem ele, um criado só para o vídeo.
+  std::unique_ptr<OpenCLUtils::DeviceContext> ownedContext;
+  OpenCLUtils::DeviceContext *deviceContext = nullptr;
+  std::unique_ptr<OpenCLUtils::FrontierBuffers> frontierBuffers;
+  // As máscaras trocam de papel a cada quadro, em vez de serem copiadas.
+  cl::Buffer mask, previousMask;
+  cl::Buffer imageTable, voronoi, output;
+  cl::Kernel updateSeeds, collectFrontier, propagate, distances;
+#ifdef EDT_STATS
+  // Os contadores se acumulam entre os quadros e não são impressos.
+  cl::Buffer stats;
+#endif
+  size_t frontierSize = 0;
+
+  size_t size() const { return static_cast<size_t>(attrs.v2[0]) * attrs.v2[1]; }
+
+  void check(const cl_int errorCode) const {
+    if (errorCode != CL_SUCCESS)
+      throw std::runtime_error(OpenCLUtils::getErrorString(errorCode));
+  }
+
+  /**
+   * \brief Lança um kernel com um work-item por pixel.
+  */
+  void runPerPixel(const cl::Kernel &kernel, std::vector<cl::Event> &events) {
+    events.emplace_back();
+    check(deviceContext->queue.enqueueNDRangeKernel(
+        kernel, cl::NullRange, cl::NDRange(size()), cl::NullRange, nullptr,
+        &events.back()));
+  }
+};
+
+VideoEDT::VideoEDT(const unsigned int width, const unsigned int height,
+                   const Options &options)
+    : m_impl(new Impl()) {
+  if (options.engine != Engine::OpenCL || options.obstacles != nullptr)
+    throw std::runtime_error("Video mode only supports the opencl engine, "
+                             "without obstacles");
+  checkMaxDistance(options.maxDistance);
+  if (width == 0 || height == 0)
+    throw std::runtime_error("The frame size must not be empty");
+  Impl &impl = *m_impl;
+  impl.options = options;
+  impl.attrs.v2[0] = width;
+  impl.attrs.v2[1] = height;
+  const size_t size = impl.size();
+
+  if (options.context != nullptr) {
+    impl.deviceContext = &options.context->deviceContext();
+  } else {
+    impl.ownedContext.reset(new OpenCLUtils::DeviceContext(
+        OpenCLUtils::getDevice(0), kernelSource()));
+    impl.deviceContext = impl.ownedContext.get();
+  }
+  OpenCLUtils::DeviceContext &deviceContext = *impl.deviceContext;
+  const cl::Context &context = deviceContext.context;
+  const cl::CommandQueue &queue = deviceContext.queue;
+  const cl::Program &program =
+      deviceContext.program(Metrics::kernelDefines(options.metric));
+
+  impl.mask = cl::Buffer(context, CL_MEM_READ_ONLY, size, nullptr);
+  impl.previousMask = cl::Buffer(context, CL_MEM_READ_ONLY, size, nullptr);
+  std::vector<cl_uint4> imageTable(1);
+  imageTable[0].v4[0] = 0;
+  imageTable[0].v4[1] = width;
+  imageTable[0].v4[2] = height;
+  imageTable[0].v4[3] = 0;
+  impl.imageTable =
+      cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                 sizeof(cl_uint4) * imageTable.size(), imageTable.data());
+  impl.voronoi = cl::Buffer(context, CL_MEM_READ_WRITE,
+                            sizeof(VoronoiDiagramMapEntry) * size, nullptr);
+  impl.output = cl::Buffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                           sizeof(cl_float) * size, nullptr);
+  // Um pixel entra no máximo uma vez em cada fronteira.
+  impl.frontierBuffers.reset(
+      new OpenCLUtils::FrontierBuffers(deviceContext, size, size));
+
+  // Antes do primeiro quadro não há fundo: a máscara anterior é toda objeto e
+  // todos os pixels têm a coordenada inválida, com todos os bits em 1.
+  impl.check(queue.enqueueFillBuffer(impl.previousMask, cl_uchar(255), 0, size));
+  impl.check(queue.enqueueFillBuffer(impl.voronoi, cl_uchar(255), 0,
+                                     sizeof(VoronoiDiagramMapEntry) * size));
+
+  impl.updateSeeds = cl::Kernel(program, "updateSeeds");
+  impl.updateSeeds.setArg(2, impl.attrs);
+  impl.updateSeeds.setArg(3, impl.voronoi);
+  impl.collectFrontier = cl::Kernel(program, "collectFrontier");
+  impl.collectFrontier.setArg(2, impl.attrs);
+  impl.collectFrontier.setArg(3, impl.voronoi);
+  impl.collectFrontier.setArg(5, impl.frontierBuffers->size);
+  impl.propagate = cl::Kernel(program, KERNELNAME);
+  impl.propagate.setArg(1, impl.imageTable);
+  impl.propagate.setArg(5, impl.voronoi);
+  impl.propagate.setArg(
+      10, Metrics::bandLimit(options.metric, options.maxDistance));
+#ifdef EDT_STATS
+  impl.stats = cl::Buffer(context, CL_MEM_READ_WRITE,
+                          sizeof(cl_uint) * OpenCLUtils::STAT_COUNT, nullptr);
+  impl.check(queue.enqueueFillBuffer(impl.stats, cl_uint(0), 0,
+                                     sizeof(cl_uint) * OpenCLUtils::STAT_COUNT));
+  impl.propagate.setArg(11, impl.stats);
+#endif
+  impl.distances = cl::Kernel(program, "distances");
+  impl.distances.setArg(0, impl.voronoi);
+  impl.distances.setArg(1, impl.attrs);
+  impl.distances.setArg(2, impl.output);
+  impl.distances.setArg(3, cl_float(options.maxDistance));
+}
+
+VideoEDT::~VideoEDT() = default;
+
+unsigned int VideoEDT::width() const { return m_impl->attrs.v2[0]; }
+
+unsigned int VideoEDT::height() const { return m_impl->attrs.v2[1]; }
+
+size_t VideoEDT::frontierSize() const { return m_impl->frontierSize; }
+
+void VideoEDT::process(const uint8_t *mask, float *output) {
+  if (mask == nullptr || output == nullptr)
+    throw std::runtime_error("The frame buffers must not be null");
+  Impl &impl = *m_impl;
+  OpenCLUtils::DeviceContext &deviceContext = *impl.deviceContext;
+  const cl::CommandQueue &queue = deviceContext.queue;
+  OpenCLUtils::FrontierBuffers &frontierBuffers = *impl.frontierBuffers;
+  const size_t size = impl.size();
+  Profiler *profiler = impl.options.profiler;
+
+  cl::Event uploadEvent;
+  {
+    Profiler::ScopedPhase phase(profiler, "upload");
+    impl.check(queue.enqueueWriteBuffer(impl.mask, CL_FALSE, 0, size, mask,
+                                        nullptr, &uploadEvent));
+  }
+
+  std::vector<cl::Event> kernelEvents;
+  {
+    Profiler::ScopedPhase phase(profiler, "kernel");
+    impl.updateSeeds.setArg(0, impl.mask);
+    impl.updateSeeds.setArg(1, impl.previousMask);
+    impl.runPerPixel(impl.updateSeeds, kernelEvents);
+
+    const cl_uint zero = 0;
+    impl.check(queue.enqueueWriteBuffer(frontierBuffers.size, CL_FALSE, 0,
+                                        sizeof(cl_uint), &zero));
+    impl.collectFrontier.setArg(0, impl.mask);
+    impl.collectFrontier.setArg(1, impl.previousMask);
+    impl.collectFrontier.setArg(
+        4, frontierBuffers.frontiers[frontierBuffers.current]);
+    impl.runPerPixel(impl.collectFrontier, kernelEvents);
+
+    cl_uint frontierSize = 0;
+    impl.check(queue.enqueueReadBuffer(frontierBuffers.size, CL_TRUE, 0,
+                                       sizeof(cl_uint), &frontierSize));
+    impl.frontierSize = frontierSize;
+
+    impl.propagate.setArg(0, impl.mask);
+    OpenCLUtils::propagateRounds(deviceContext, impl.propagate, frontierBuffers,
+                                 frontierSize, &kernelEvents);
+    impl.runPerPixel(impl.distances, kernelEvents);
+  }
+
+  cl::Event readbackEvent;
+  {
+    Profiler::ScopedPhase phase(profiler, "readback");
+    impl.check(queue.enqueueReadBuffer(impl.output, CL_TRUE, 0,
+                                       sizeof(cl_float) * size, output, nullptr,
+                                       &readbackEvent));
+  }
+  // A máscara deste quadro é a anterior do próximo.
+  std::swap(impl.mask, impl.previousMask);
+
+  if (profiler != nullptr) {
+    profiler->addDeviceTime("upload", OpenCLUtils::getEventMs(uploadEvent));
+    for (const cl::Event &event : kernelEvents)
+      profiler->addDeviceTime("kernel", OpenCLUtils::getEventMs(event));
+    profiler->addDeviceTime("readback", OpenCLUtils::getEventMs(readbackEvent));
+  }
+}
+
+} // namespace EucliGPU
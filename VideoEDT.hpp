@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "DistanceTransform.hpp"
+
+namespace EucliGPU {
+
+/**
+ * \brief Transformada de distância de uma sequência de quadros do mesmo
+ * tamanho, como as máscaras de um vídeo. O diagrama de Voronoi do quadro
+ * anterior fica no dispositivo, e cada quadro só é repropagado a partir dos
+ * pixels afetados pelas diferenças entre as duas máscaras, como no
+ * IncrementalEDT. Por quadro, só a máscara é enviada e as distâncias lidas.
+ * Suporta apenas a engine OpenCL, com qualquer métrica e sem obstáculos.
+*/
+class VideoEDT {
+public:
+  VideoEDT(const unsigned int width, const unsigned int height,
+           const Options &options = Options());
+  ~VideoEDT();
+
+  unsigned int width() const;
+  unsigned int height() const;
+
+  /**
+   * \brief Calcula as distâncias do próximo quadro em output. O primeiro quadro
+   * é propagado inteiro, a partir de todas as sementes.
+  */
+  void process(const uint8_t *mask, float *output);
+
+  /**
+   * \brief Pixels de onde o último quadro foi repropagado, que medem o quanto
+   * ele mudou em relação ao anterior.
+  */
+  size_t frontierSize() const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace EucliGPU
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/**
+ * \brief Leitura e escrita de vídeos de máscaras para o modo de vídeo: Y4M, do
+ * qual só o plano de luminância é usado, ou quadros brutos de 8 bits por pixel
+ * sem cabeçalho.
+*/
+namespace VideoIO {
+
+struct Format {
+  unsigned int width = 0;
+  unsigned int height = 0;
+  bool y4m = false;
+  // Parâmetros do cabeçalho Y4M repassados à saída, como a taxa de quadros.
+  std::string parameters;
+  // Bytes dos planos de crominância que seguem o plano Y, descartados.
+  size_t chromaSize = 0;
+
+  size_t frameSize() const { return static_cast<size_t>(width) * height; }
+};
+
+/**
+ * \brief Formato dos quadros brutos de tamanho width x height.
+*/
+inline Format raw(const unsigned int width, const unsigned int height) {
+  Format format;
+  format.width = width;
+  format.height = height;
+  return format;
+}
+
+/**
+ * \brief Lê o cabeçalho de um fluxo Y4M. Sem o parâmetro C, o espaço de cores é
+ * o 4:2:0 padrão do formato.
+*/
+inline Format readY4MHeader(std::istream &in) {
+  std::string line;
+  if (!std::getline(in, line))
+    throw std::runtime_error("Missing Y4M header");
+  std::istringstream tokens(line);
+  std::string token;
+  tokens >> token;
+  if (token != "YUV4MPEG2")
+    throw std::runtime_error("The input is not a Y4M stream");
+
+  Format format;
+  format.y4m = true;
+  std::string colorspace = "420";
+  while (tokens >> token) {
+    if (token[0] == 'W')
+      format.width = std::stoul(token.substr(1));
+    else if (token[0] == 'H')
+      format.height = std::stoul(token.substr(1));
+    else if (token[0] == 'C')
+      colorspace = token.substr(1);
+    else
+      format.parameters += " " + token;
+  }
+  if (format.width == 0 || format.height == 0)
+    throw std::runtime_error("The Y4M header has no frame size");
+
+  const size_t halfWidth = (format.width + 1) / 2;
+  const size_t halfHeight = (format.height + 1) / 2;
+  if (colorspace.compare(0, 4, "mono") == 0)
+    format.chromaSize = 0;
+  else if (colorspace == "444alpha")
+    format.chromaSize = 3 * format.frameSize();
+  else if (colorspace.compare(0, 3, "444") == 0)
+    format.chromaSize = 2 * format.frameSize();
+  else if (colorspace.compare(0, 3, "422") == 0)
+    format.chromaSize = 2 * halfWidth * format.height;
+  else if (colorspace.compare(0, 3, "420") == 0)
+    format.chromaSize = 2 * halfWidth * halfHeight;
+  else if (colorspace.compare(0, 3, "411") == 0)
+    format.chromaSize = 2 * ((format.width + 3) / 4) * format.height;
+  else
+    throw std::runtime_error("Unsupported Y4M colorspace " + colorspace);
+  return format;
+}
+
+/**
+ * \brief Lê o plano Y do próximo quadro em frame. Retorna falso no fim do
+ * fluxo; um quadro incompleto é um erro.
+*/
+inline bool readFrame(std::istream &in, const Format &format,
+                      unsigned char *frame) {
+  if (format.y4m) {
+    std::string line;
+    if (!std::getline(in, line))
+      return false;
+    if (line.compare(0, 5, "FRAME") != 0)
+      throw std::runtime_error("Invalid Y4M frame header");
+  }
+
+  in.read(reinterpret_cast<char *>(frame), format.frameSize());
+  const size_t read = in.gcount();
+  if (read == 0 && !format.y4m)
+    return false;
+  if (read != format.frameSize())
+    throw std::runtime_error("Truncated video frame");
+  in.ignore(format.chromaSize);
+  if (static_cast<size_t>(in.gcount()) != format.chromaSize)
+    throw std::runtime_error("Truncated video frame");
+  return true;
+}
+
+/**
+ * \brief A saída Y4M é monocromática, com os demais parâmetros da entrada.
+*/
+inline void writeHeader(std::ostream &out, const Format &format) {
+  if (format.y4m)
+    out << "YUV4MPEG2 W" << format.width << " H" << format.height
+        << format.parameters << " Cmono\n";
+}
+
+/**
+ * \brief Escreve um quadro e esvazia o buffer, para que um consumidor em
+ * tempo real receba cada quadro assim que ele fica pronto.
+*/
+inline void writeFrame(std::ostream &out, const Format &format,
+                       const unsigned char *frame) {
+  if (format.y4m)
+    out << "FRAME\n";
+  out.write(reinterpret_cast<const char *>(frame), format.frameSize());
+  out.flush();
+  if (!out)
+    throw std::runtime_error("The video frame could not be written");
+}
+
+} // namespace VideoIO
@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+
+#include "BufferPool.hpp"
+#include "Context.hpp"
+#include "DistanceTransform.hpp"
+#include "Engines.hpp"
+#include "MaskGenerators.hpp"
+#include "Metrics.hpp"
+#include "Profiling.hpp"
+#include "Verification.hpp"
+
+using EucliGPU::allEngines;
+using EucliGPU::engineName;
+using EucliGPU::parseEngine;
+
+std::vector<std::string> split(const std::string &value, const char separator) {
+  std::vector<std::string> items;
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, separator))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+/**
+ * \brief Percentil pelo método do posto mais próximo, sobre amostras ordenadas.
+*/
+double percentile(const std::vector<double> &sorted, const double p) {
+  const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+struct BenchOptions {
+  std::vector<unsigned int> sizes = {256, 512, 1024, 2048, 4096, 8192, 16384};
+  std::vector<std::string> patterns = MaskGenerators::patterns;
+  std::vector<double> densities = {0.0001, 0.001, 0.01};
+  std::vector<Engine> engines = allEngines;
+  EucliGPU::Metric metric = EucliGPU::Metric::Euclidean;
+  float maxDistance = INFINITY;
+  unsigned int warmup = 1;
+  unsigned int repetitions = 5;
+  // Máscaras iguais processadas por chamada, com computeEDTBatch quando > 1.
+  unsigned int batch = 1;
+  uint32_t seed = 42;
+  // No modo de verificação as engines não são medidas, apenas comparadas com
+  // a transformada exata.
+  bool verify = false;
+  // Só compila o kernel de cada métrica e variante, sem medir nada.
+  bool buildKernels = false;
+  float tolerance = 1e-3f;
+  // Fração dos pixels de cada máscara que pode passar da tolerância sem que a
+  // engine falhe, desde que nenhum erre mais que maxError. Com 0, qualquer
+  // pixel divergente é uma falha.
+  double maxMismatchFraction = 0;
+  float maxError = 1;
+  // Layouts da engine OpenCL medidos: 0 é a ordem de linhas, e n os blocos de
+  // n x n pixels de Options::tileSize.
+  std::vector<unsigned int> tileSizes = {0};
+  // De onde a engine OpenCL lê a máscara: buffer ou image, de
+  // Options::maskImage.
+  std::vector<std::string> maskSources = {"buffer"};
+  // Dispositivo da engine OpenCL, criado uma vez e compartilhado por todas as
+  // medições, para que o aquecimento já encontre os kernels compilados.
+  EucliGPU::Context *context = nullptr;
+};
+
+/**
+ * \brief Uma engine e, na OpenCL, o layout dos buffers no dispositivo.
+*/
+struct Variant {
+  Engine engine;
+  unsigned int tileSize;
+  bool maskImage;
+
+  std::string name() const {
+    std::string result = engineName(engine);
+    if (tileSize > 0)
+      result += "/" + std::to_string(tileSize);
+    if (maskImage)
+      result += "/img";
+    return result;
+  }
+};
+
+/**
+ * \brief As engines de options, com a OpenCL repetida para cada tamanho de
+ * bloco e cada origem da máscara.
+*/
+std::vector<Variant> variants(const BenchOptions &options) {
+  std::vector<Variant> result;
+  for (const Engine engine : options.engines) {
+    if (engine != Engine::OpenCL) {
+      result.push_back(Variant{engine, 0, false});
+      continue;
+    }
+    for (const unsigned int tileSize : options.tileSizes)
+      for (const std::string &maskSource : options.maskSources)
+        result.push_back(Variant{engine, tileSize, maskSource == "image"});
+  }
+  return result;
+}
+
+BenchOptions parseOptions(int argc, char const *argv[]) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--verify") {
+      options.verify = true;
+      continue;
+    }
+    if (arg == "--build-kernels") {
+      options.buildKernels = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      throw std::runtime_error("Missing value for option " + arg);
+    const std::string value(argv[++i]);
+
+    if (arg == "--sizes") {
+      options.sizes.clear();
+      for (const std::string &size : split(value, ','))
+        options.sizes.push_back(std::stoul(size));
+    } else if (arg == "--patterns") {
+      options.patterns = split(value, ',');
+    } else if (arg == "--densities") {
+      options.densities.clear();
+      for (const std::string &density : split(value, ','))
+        options.densities.push_back(std::stod(density));
+    } else if (arg == "--engines") {
+      options.engines.clear();
+      for (const std::string &engine : split(value, ','))
+        options.engines.push_back(parseEngine(engine));
+    } else if (arg == "--metric") {
+      options.metric = EucliGPU::parseMetric(value);
+    } else if (arg == "--max-distance") {
+      options.maxDistance = std::stof(value);
+    } else if (arg == "--warmup") {
+      options.warmup = std::stoul(value);
+    } else if (arg == "--reps") {
+      options.repetitions = std::max(1ul, std::stoul(value));
+    } else if (arg == "--batch") {
+      options.batch = std::max(1ul, std::stoul(value));
+    } else if (arg == "--tolerance") {
+      options.tolerance = std::stof(value);
+    } else if (arg == "--max-mismatch-fraction") {
+      options.maxMismatchFraction = std::stod(value);
+    } else if (arg == "--max-error") {
+      options.maxError = std::stof(value);
+    } else if (arg == "--tile-sizes") {
+      options.tileSizes.clear();
+      for (const std::string &tileSize : split(value, ','))
+        options.tileSizes.push_back(std::stoul(tileSize));
+    } else if (arg == "--mask-sources") {
+      options.maskSources = split(value, ',');
+      for (const std::string &maskSource : options.maskSources)
+        if (maskSource != "buffer" && maskSource != "image")
+          throw std::runtime_error("Unknown mask source " + maskSource);
+    } else if (arg == "--seed") {
+      options.seed = std::stoul(value);
+    } else {
+      throw std::runtime_error("Unknown option " + arg);
+    }
+  }
+  return options;
+}
+
+void runEngine(const Variant &variant, const BenchOptions &benchOptions,
+               const UCImage *image, float *output) {
+  EucliGPU::Options options;
+  options.engine = variant.engine;
+  options.tileSize = variant.tileSize;
+  options.maskImage = variant.maskImage;
+  options.metric = benchOptions.metric;
+  options.maxDistance = benchOptions.maxDistance;
+  options.context = benchOptions.context;
+  EucliGPU::computeEDT(image->image, image->attrs.v2[0], image->attrs.v2[1],
+                       options, output);
+}
+
+/**
+ * \brief Tempos das repetições em milissegundos, ordenados. kernel e layout
+ * são os tempos de dispositivo das fases de mesmo nome do Profiler, medidos
+ * pelos eventos do OpenCL, e ficam vazios nas engines do host.
+*/
+struct Measurement {
+  std::vector<double> total;
+  std::vector<double> kernel;
+  std::vector<double> layout;
+};
+
+/**
+ * \brief Tempo de dispositivo da fase name, negativo se ela não teve eventos.
+*/
+double deviceMs(const Profiler &profiler, const std::string &name) {
+  for (const Profiler::Phase &phase : profiler.phases())
+    if (phase.name == name)
+      return phase.deviceMs;
+  return -1;
+}
+
+/**
+ * \brief Mede as repetições de uma engine sobre uma máscara, ou sobre um lote
+ * de options.batch cópias dela.
+*/
+Measurement measure(const Variant &variant, const UCImage *image,
+                    const BenchOptions &options) {
+  const size_t size = static_cast<size_t>(image->attrs.v2[0]) * image->attrs.v2[1];
+  std::vector<float> output(size * options.batch);
+  std::vector<EucliGPU::BatchItem> items;
+  for (unsigned int i = 0; i < options.batch; i++)
+    items.push_back(EucliGPU::BatchItem{image->image, image->attrs.v2[0],
+                                        image->attrs.v2[1],
+                                        output.data() + i * size});
+  // As repetições reaproveitam os buffers do host e o contexto, como um
+  // serviço que processa imagens em sequência; o aquecimento faz as alocações
+  // e compila a variante do kernel.
+  EucliGPU::BufferPool buffers;
+  EucliGPU::Options engineOptions;
+  engineOptions.engine = variant.engine;
+  engineOptions.tileSize = variant.tileSize;
+  engineOptions.maskImage = variant.maskImage;
+  engineOptions.metric = options.metric;
+  engineOptions.maxDistance = options.maxDistance;
+  engineOptions.buffers = &buffers;
+  engineOptions.context = options.context;
+  const auto run = [&]() {
+    if (options.batch > 1) {
+      EucliGPU::computeEDTBatch(items, engineOptions);
+    } else {
+      const UCImage &mask = *image;
+      EucliGPU::computeEDT(mask.image, mask.attrs.v2[0], mask.attrs.v2[1],
+                           engineOptions, output.data());
+    }
+  };
+
+  for (unsigned int i = 0; i < options.warmup; i++)
+    run();
+
+  Measurement measurement;
+  for (unsigned int i = 0; i < options.repetitions; i++) {
+    Profiler profiler;
+    engineOptions.profiler = &profiler;
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    measurement.total.push_back(elapsed.count());
+    const double kernelMs = deviceMs(profiler, "kernel");
+    if (kernelMs >= 0) {
+      measurement.kernel.push_back(kernelMs);
+      // A conversão de layout só existe com blocos; sem ela, custa zero.
+      measurement.layout.push_back(std::max(0.0, deviceMs(profiler, "layout")));
+    }
+  }
+  std::sort(measurement.total.begin(), measurement.total.end());
+  std::sort(measurement.kernel.begin(), measurement.kernel.end());
+  std::sort(measurement.layout.begin(), measurement.layout.end());
+  return measurement;
+}
+
+/**
+ * \brief Compara a saída de cada engine com a transformada exata. Em máscaras
+ * pequenas a própria referência é conferida contra a força bruta.
+ * Retorna falso se alguma engine divergir além de maxMismatchFraction e
+ * maxError, ou falhar ao executar; a referência não tem tolerância. Uma engine
+ * que falhou vai para failed e não é executada de novo.
+*/
+bool verify(const std::string &name, const UCImage *image,
+            const BenchOptions &options, std::vector<Engine> &failed) {
+  const unsigned int width = image->attrs.v2[0];
+  const size_t size = static_cast<size_t>(width) * image->attrs.v2[1];
+  const size_t bruteForceLimit = 128 * 128;
+  bool passed = true;
+
+  std::vector<float> expected(size), actual(size);
+  exactDT(image, expected.data(), options.metric, options.maxDistance);
+  // A força bruta não conhece a faixa e só confere a referência sem ela.
+  if (size <= bruteForceLimit && std::isinf(options.maxDistance)) {
+    sequentialDT(image, actual.data(), options.metric);
+    const Comparison comparison = compareDistances(
+        expected.data(), actual.data(), size, options.tolerance);
+    if (!comparison.matches()) {
+      std::cout << "reference disagrees with brute force on " << name << "\n";
+      printMismatches(std::cout, comparison, actual.data(), expected.data(),
+                      width);
+      passed = false;
+    }
+  }
+
+  for (const Variant &variant : variants(options)) {
+    if (std::find(failed.begin(), failed.end(), variant.engine) !=
+        failed.end())
+      continue;
+    try {
+      runEngine(variant, options, image, actual.data());
+    } catch (const std::runtime_error &e) {
+      // Um kernel que não compila é um erro como qualquer divergência.
+      std::cout << std::left << std::setw(14) << variant.name()
+                << std::setw(20) << name << std::right << std::setw(8) << width
+                << std::setw(32) << "FAIL" << std::endl
+                << "  " << e.what() << std::endl;
+      failed.push_back(variant.engine);
+      passed = false;
+      continue;
+    }
+
+    const Comparison comparison = compareDistances(
+        expected.data(), actual.data(), size, options.tolerance);
+    // Os erros conhecidos da propagação IWPP, uma fração de pixel em poucos
+    // pixels, são aceitos dentro dos limites.
+    const bool tolerated =
+        comparison.maxError <= options.maxError &&
+        comparison.mismatches <= options.maxMismatchFraction * size;
+    std::cout << std::left << std::setw(14) << variant.name()
+              << std::setw(20) << name << std::right << std::setw(8) << width
+              << std::setw(12) << comparison.maxError << std::setw(12)
+              << comparison.mismatches << std::setw(8)
+              << (comparison.matches() ? "ok" : tolerated ? "within" : "FAIL")
+              << std::endl;
+    if (!comparison.matches() && !tolerated) {
+      printMismatches(std::cout, comparison, expected.data(), actual.data(),
+                      width);
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+/**
+ * \brief Compila o programa de cada métrica com cada variante que a biblioteca
+ * usa: ordem de linhas, blocos, instâncias e, com suporte a imagens, a máscara
+ * em image2d_t. Retorna falso se alguma não compilar.
+*/
+bool buildKernels(EucliGPU::Context &context) {
+  OpenCLUtils::DeviceContext &deviceContext = context.deviceContext();
+  std::vector<std::string> variants = {"", "-DTILE_SIZE=16", "-DINSTANCES"};
+  if (deviceContext.device.getInfo<CL_DEVICE_IMAGE_SUPPORT>()) {
+    variants.push_back("-DMASK_IMAGE");
+    variants.push_back("-DTILE_SIZE=16 -DMASK_IMAGE");
+  }
+  bool passed = true;
+  for (const EucliGPU::Metric metric : EucliGPU::allMetrics)
+    for (const std::string &variant : variants) {
+      const std::string defines = Metrics::kernelDefines(metric) +
+                                  (variant.empty() ? "" : " " + variant);
+      std::cout << std::left << std::setw(40) << defines << std::flush;
+      try {
+        deviceContext.program(defines);
+        std::cout << "ok" << std::endl;
+      } catch (const std::runtime_error &e) {
+        std::cout << "FAIL\n" << e.what() << std::endl;
+        passed = false;
+      }
+    }
+  return passed;
+}
+
+int main(int argc, char const *argv[]) {
+  BenchOptions options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl
+              << "Usage: " << argv[0]
+              << " [--sizes 256,1024] [--patterns sparse,center,circles,lines,"
+                 "checkerboard] [--densities 0.001] [--engines opencl,cpu,exact]"
+                 " [--metric euclidean] [--max-distance 32] [--tile-sizes 0,8]"
+                 " [--mask-sources buffer,image]"
+                 " [--warmup 1] [--reps 5] [--batch 1] [--seed 42]"
+                 " [--verify [--tolerance 0.001] [--max-mismatch-fraction 0]"
+                 " [--max-error 1]] [--build-kernels]"
+              << std::endl;
+    return -1;
+  }
+
+  if (options.buildKernels) {
+    std::unique_ptr<EucliGPU::Context> context;
+    try {
+      context.reset(new EucliGPU::Context());
+    } catch (const std::runtime_error &e) {
+      std::cerr << "No OpenCL device to build the kernel on: " << e.what()
+                << std::endl;
+      return 1;
+    }
+    std::cout << "Building the kernel on " << context->deviceName()
+              << std::endl;
+    return buildKernels(*context) ? 0 : 1;
+  }
+
+  std::cout << std::left << std::setw(14) << "engine" << std::setw(20)
+            << "pattern" << std::right << std::setw(8) << "size";
+  if (options.verify)
+    std::cout << std::setw(12) << "max error" << std::setw(12) << "mismatches"
+              << std::setw(8) << "status" << std::endl;
+  else
+    std::cout << std::setw(12) << "median ms" << std::setw(12) << "p95 ms"
+              << std::setw(10) << "MP/s" << std::setw(12) << "kernel ms"
+              << std::setw(12) << "layout ms" << std::endl;
+
+  std::vector<Engine> unavailable;
+  std::unique_ptr<EucliGPU::Context> context;
+  if (std::find(options.engines.begin(), options.engines.end(),
+                Engine::OpenCL) != options.engines.end()) {
+    try {
+      context.reset(new EucliGPU::Context());
+      options.context = context.get();
+    } catch (const std::runtime_error &e) {
+      // Na verificação, a engine pedida sem dispositivo é uma falha.
+      if (options.verify) {
+        std::cerr << "No OpenCL device to verify on: " << e.what()
+                  << std::endl;
+        return 1;
+      }
+      std::cerr << "Skipping engine opencl: " << e.what() << std::endl;
+      unavailable.push_back(Engine::OpenCL);
+    }
+  }
+
+  bool passed = true;
+  for (const unsigned int size : options.sizes)
+    for (const std::string &pattern : options.patterns) {
+      // O padrão sparse é repetido para cada densidade.
+      const std::vector<double> densities =
+          pattern == "sparse" ? options.densities : std::vector<double>{0};
+      for (const double density : densities) {
+        std::vector<unsigned char> mask = MaskGenerators::generate(
+            pattern, size, size, density, options.seed);
+        const UCImage image = constructUCImage(mask.data(), size, size);
+        std::string name = pattern;
+        if (pattern == "sparse") {
+          std::ostringstream stream;
+          stream << pattern << "@" << density;
+          name = stream.str();
+        }
+
+        if (options.verify) {
+          passed = verify(name, &image, options, unavailable) && passed;
+          continue;
+        }
+
+        for (const Variant &variant : variants(options)) {
+          if (std::find(unavailable.begin(), unavailable.end(),
+                        variant.engine) != unavailable.end())
+            continue;
+
+          Measurement measurement;
+          try {
+            measurement = measure(variant, &image, options);
+          } catch (const std::runtime_error &e) {
+            // Uma engine sem dispositivo não impede as demais de serem medidas.
+            std::cerr << "Skipping engine " << variant.name() << ": "
+                      << e.what() << std::endl;
+            unavailable.push_back(variant.engine);
+            continue;
+          } catch (const std::bad_alloc &) {
+            // Só este tamanho não cabe na memória do host.
+            std::cerr << "Skipping " << variant.name() << " at " << size
+                      << ": out of host memory" << std::endl;
+            continue;
+          }
+
+          const std::vector<double> &times = measurement.total;
+          const double median = percentile(times, 0.5);
+          const double megapixels =
+              static_cast<double>(size) * size * options.batch / 1e6;
+          std::cout << std::left << std::setw(14) << variant.name()
+                    << std::setw(20) << name << std::right << std::setw(8)
+                    << size << std::fixed << std::setprecision(3)
+                    << std::setw(12) << median << std::setw(12)
+                    << percentile(times, 0.95) << std::setprecision(2)
+                    << std::setw(10) << megapixels / (median / 1e3)
+                    << std::setprecision(3);
+          for (const std::vector<double> *device :
+               {&measurement.kernel, &measurement.layout}) {
+            if (device->empty())
+              std::cout << std::setw(12) << "-";
+            else
+              std::cout << std::setw(12) << percentile(*device, 0.5);
+          }
+          std::cout << std::endl;
+          std::cout.unsetf(std::ios::floatfield);
+        }
+      }
+    }
+
+  return passed ? 0 : 1;
+}
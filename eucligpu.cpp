@@ -1,45 +1,35 @@
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "OpenCLUtils.hpp"
+#include "Autotuner.hpp"
+#include "Context.hpp"
+#include "Daemon.hpp"
+#include "DistanceTransform.hpp"
+#include "LabelEDT.hpp"
+#include "Morphology.hpp"
+#include "Profiling.hpp"
+#include "Scheduler.hpp"
+#include "Skeleton.hpp"
+#include "VideoEDT.hpp"
+#include "VideoIO.hpp"
 #include "stb_image.h"
 #include "stb_image_write.h"
 
-#define KERNELNAME "euclidean"
-
-
-void sequentialDT(const UCImage *image, float *imageOutput) {
-
-  for(unsigned int x=0; x < image->attrs.v2[0]; ++x) {
-    for(unsigned int y=0; y < image->attrs.v2[1]; ++y) {
-
-      float minDistance = std::numeric_limits<float>::max();
-
-      cl_uint4 coord1 = constructCoord(y, x, image->attrs.v2[1]);
-      for(unsigned int innerX = 0; innerX < image->attrs.v2[0]; ++innerX) {
-        for(unsigned int innerY = 0; innerY < image->attrs.v2[1]; ++innerY) {
-
-          const cl_uint4 coord2 = constructCoord(innerY, innerX, image->attrs.v2[1]);
-
-          if(!isBackgroudByCoord(image, coord2)) {
-            const float distance = euclideanDistance(coord1, coord2);
-
-            if(distance < minDistance)
-              minDistance = distance;
-            
-          }
-        }
-      }
-      imageOutput[image->attrs.v2[0]*y + x] = minDistance;
-    }
-  }
-
-}
 
 unsigned char floatToPixVal(const float imageValue) {
+  // Também cobre as distâncias infinitas das imagens sem fundo.
+  if (!(imageValue < 1.0f))
+    return 255u;
   int tmpval = static_cast<int>(::std::floor(256 * imageValue));
   if (tmpval < 0) {
       return 0u;
@@ -50,6 +40,23 @@ unsigned char floatToPixVal(const float imageValue) {
   }
 }
 
+/**
+ * \brief Normaliza as distâncias pela diagonal da imagem para gravá-las com 8 bits.
+ * Com a métrica Squared a diagonal também é elevada ao quadrado. Com uma faixa,
+ * normaliza por ela, e os pixels saturados ficam brancos.
+*/
+void encodeDistances(const float *distances, const int imageWidth,
+                     const int imageHeight, unsigned char *output,
+                     const EucliGPU::Metric metric = EucliGPU::Metric::Euclidean,
+                     const float band = INFINITY) {
+  float maxDistance = std::pow(imageWidth, 2) + std::pow(imageHeight, 2);
+  if (metric != EucliGPU::Metric::Squared)
+    maxDistance = std::sqrt(maxDistance);
+  maxDistance = std::min(maxDistance, band);
+  for (int i = 0; i < imageWidth * imageHeight; i++)
+    output[i] = floatToPixVal(distances[i] / maxDistance);
+}
+
 template<typename T>
 std::vector<std::vector<T>> SplitVector(const std::vector<T>& vec, size_t n) {
     std::vector<std::vector<T>> outVec;
@@ -74,117 +81,576 @@ std::vector<std::vector<T>> SplitVector(const std::vector<T>& vec, size_t n) {
 
 class ExecuteDT {
 public:
-  ExecuteDT(const std::string &filename)
-      : m_filename(filename), m_image(nullptr), m_output(nullptr){};
+  ExecuteDT(const std::string &filename, const EucliGPU::Options &options,
+            const std::string &obstaclesFilename = "")
+      : m_filename(filename), m_obstaclesFilename(obstaclesFilename),
+        m_image(nullptr), m_obstacles(nullptr), m_options(options){};
 
   void execute() {
     // As imagens esperadas são sempre com apenas um canal.
     int imageWidth, imageHeight;
+    Profiler::ScopedPhase decodePhase(m_options.profiler, "decode");
     m_image = stbi_load(m_filename.c_str(), &imageWidth, &imageHeight,
                         nullptr, 1);
     if (m_image == nullptr)
       throw std::runtime_error("The image could not be loaded, please check if "
                                "the filename is corrected");
 
-    const UCImage image = constructUCImage(m_image, imageHeight, imageWidth);
+    EucliGPU::Options options = m_options;
+    if (!m_obstaclesFilename.empty()) {
+      int obstaclesWidth, obstaclesHeight;
+      m_obstacles = stbi_load(m_obstaclesFilename.c_str(), &obstaclesWidth,
+                              &obstaclesHeight, nullptr, 1);
+      if (m_obstacles == nullptr)
+        throw std::runtime_error("The obstacle image could not be loaded, "
+                                 "please check if the filename is corrected");
+      if (obstaclesWidth != imageWidth || obstaclesHeight != imageHeight)
+        throw std::runtime_error("The obstacle image must have the same size "
+                                 "as the image");
+      options.obstacles = m_obstacles;
+    }
+    decodePhase.stop();
+
     const int imageSize = imageWidth * imageHeight;
 
-    // Paralelo
-    // Initialization
-    
-    VoronoiDiagramMap voronoi;
-    voronoi.sizeOfDiagram = imageSize;
-    voronoi.entries = new VoronoiDiagramMapEntry[voronoi.sizeOfDiagram];
-    // É usado o vector pois é mais fácil extrair o array primitivo para se passar a
-    // posteriori ao kernel.
-    std::vector<cl_uint4> queue;
-    for (int x = 0; x < imageWidth; x++)
-      for (int y = 0; y < imageHeight; y++) {
-        cl_uint4 coordinate = constructCoord(y, x, imageWidth);
-        Neighborhood neighborhood = getNeighborhood(&image, getPixel(&image, coordinate));
-
-        if (isBackgroudByCoord(&image, coordinate)) {
-          voronoi.entries[coordinate.v4[2]] =
-            VoronoiDiagramMapEntry{ coordinate, coordinate };
-
-          for (int i = 0; i < neighborhood.size; i++) {
-            const cl_uint4 pixel = neighborhood.pixels[i];
-            if (!isBackgroudByCoord(&image, pixel)) {
-              queue.push_back(coordinate);
-              break;
-            }
-          }
-        } else {
-          voronoi.entries[coordinate.v4[2]] = 
-            VoronoiDiagramMapEntry{ coordinate, constructInvalidCoord() };
-        }
-      }
-    if (!queue.empty()) {
-      // Wavefront propagation
-      OpenCLUtils::executeOpenCL(KERNELNAME, ExecuteDT::readKernel(), &image,
-                                queue, &voronoi);
-    }
+    std::vector<float> distances(imageSize);
+    EucliGPU::computeEDT(m_image, imageWidth, imageHeight, options,
+                         distances.data());
 
     // Distance calculation
-    float maxDistance = std::sqrt(std::pow(imageWidth, 2) + std::pow(imageHeight, 2));
-    m_output = new unsigned char[imageSize];
-    assert(m_output != nullptr);
-    for (int x = 0; x < imageWidth; x++)
-      for (int y = 0; y < imageHeight; y++) {
-        cl_uint4 coordinate = constructCoord(y, x, imageWidth);
-        cl_uint4 nearest = voronoi
-          .entries[coordinate.v4[2]]
-          .nearestBackground;
-        
-        float distance = euclideanDistance(coordinate, nearest);
-        m_output[coordinate.v4[2]] = floatToPixVal(distance / maxDistance);
-      }
-    free(voronoi.entries);
-    stbi_write_bmp("result.bmp", imageWidth, imageHeight, 1, m_output);
+    Profiler::ScopedPhase finalizePhase(m_options.profiler, "finalize");
+    std::vector<unsigned char> output(imageSize);
+    encodeDistances(distances.data(), imageWidth, imageHeight, output.data(),
+                    m_options.metric, m_options.maxDistance);
+    finalizePhase.stop();
+
+    Profiler::ScopedPhase encodePhase(m_options.profiler, "encode");
+    stbi_write_bmp("result.bmp", imageWidth, imageHeight, 1, output.data());
   }
 
   ~ExecuteDT() {
     if (m_image != nullptr)
       stbi_image_free(m_image);
 
-    if (m_output != nullptr)
-      free(m_output);
+    if (m_obstacles != nullptr)
+      stbi_image_free(m_obstacles);
   };
 
 private:
   const std::string m_filename;
+  const std::string m_obstaclesFilename;
   unsigned char *m_image;
-  unsigned char *m_output;
-
-  static std::string readKernel() {
-    std::ifstream input("kernel.cl");
-    std::string source;
-    input.seekg(0, std::ios::end);
-    source.reserve(input.tellg());
-    input.seekg(0, std::ios::beg);
-    source.assign((std::istreambuf_iterator<char>(input)),
-                  std::istreambuf_iterator<char>());
-    return source;
+  unsigned char *m_obstacles;
+  const EucliGPU::Options m_options;
+};
+
+/**
+ * \brief Processa várias imagens de uma vez, distribuindo-as entre todos os
+ * dispositivos OpenCL. A saída da i-ésima imagem é gravada em result_i.bmp.
+*/
+class ExecuteBatchDT {
+public:
+  ExecuteBatchDT(const std::vector<std::string> &filenames,
+                 const EucliGPU::Options &options,
+                 const EucliGPU::DeviceOptions &deviceOptions)
+      : m_filenames(filenames), m_metric(options.metric),
+        m_maxDistance(options.maxDistance), m_profiler(options.profiler),
+        m_deviceOptions(deviceOptions){};
+
+  void execute() {
+    Profiler::ScopedPhase decodePhase(m_profiler, "decode");
+    std::vector<int> widths(m_filenames.size()), heights(m_filenames.size());
+    for (size_t i = 0; i < m_filenames.size(); i++) {
+      m_images.push_back(stbi_load(m_filenames[i].c_str(), &widths[i],
+                                   &heights[i], nullptr, 1));
+      if (m_images.back() == nullptr)
+        throw std::runtime_error("The image " + m_filenames[i] +
+                                 " could not be loaded, please check if the "
+                                 "filename is corrected");
+    }
+    decodePhase.stop();
+
+    Profiler::ScopedPhase setupPhase(m_profiler, "setup");
+    EucliGPU::Scheduler scheduler(m_deviceOptions);
+    setupPhase.stop();
+
+    std::vector<std::vector<float>> distances(m_filenames.size());
+    std::vector<EucliGPU::BatchItem> items;
+    for (size_t i = 0; i < m_filenames.size(); i++) {
+      distances[i].resize(static_cast<size_t>(widths[i]) * heights[i]);
+      items.push_back(EucliGPU::BatchItem{
+          m_images[i], static_cast<unsigned int>(widths[i]),
+          static_cast<unsigned int>(heights[i]), distances[i].data()});
+    }
+    Profiler::ScopedPhase kernelPhase(m_profiler, "kernel");
+    scheduler.run(items, m_metric, m_maxDistance);
+    kernelPhase.stop();
+
+    const std::vector<std::string> names = scheduler.deviceNames();
+    const std::vector<double> throughputs = scheduler.throughputs();
+    for (size_t i = 0; i < names.size(); i++)
+      std::clog << names[i] << ": " << throughputs[i] << " MP/s\n";
+
+    Profiler::ScopedPhase encodePhase(m_profiler, "encode");
+    for (size_t i = 0; i < m_filenames.size(); i++) {
+      std::vector<unsigned char> output(distances[i].size());
+      encodeDistances(distances[i].data(), widths[i], heights[i], output.data(),
+                      m_metric, m_maxDistance);
+      const std::string path = "result_" + std::to_string(i) + ".bmp";
+      stbi_write_bmp(path.c_str(), widths[i], heights[i], 1, output.data());
+    }
   }
+
+  ~ExecuteBatchDT() {
+    for (unsigned char *image : m_images)
+      if (image != nullptr)
+        stbi_image_free(image);
+  };
+
+private:
+  const std::vector<std::string> m_filenames;
+  const EucliGPU::Metric m_metric;
+  const float m_maxDistance;
+  std::vector<unsigned char *> m_images;
+  Profiler *m_profiler;
+  const EucliGPU::DeviceOptions m_deviceOptions;
 };
 
+/**
+ * \brief Processa um vídeo de máscaras lido da entrada padrão, quadro a quadro,
+ * e escreve as distâncias de cada quadro, com 8 bits, na saída padrão, no mesmo
+ * formato da entrada. Cada quadro parte do diagrama do anterior.
+*/
+class ExecuteVideoDT {
+public:
+  ExecuteVideoDT(const VideoIO::Format &format, const EucliGPU::Options &options)
+      : m_format(format), m_options(options){};
+
+  void execute() {
+    VideoIO::Format format = m_format;
+    if (format.y4m)
+      format = VideoIO::readY4MHeader(std::cin);
+
+    Profiler::ScopedPhase setupPhase(m_options.profiler, "setup");
+    EucliGPU::VideoEDT video(format.width, format.height, m_options);
+    setupPhase.stop();
+
+    std::vector<unsigned char> mask(format.frameSize());
+    std::vector<unsigned char> output(format.frameSize());
+    std::vector<float> distances(format.frameSize());
+    VideoIO::writeHeader(std::cout, format);
+    for (;;) {
+      {
+        Profiler::ScopedPhase decodePhase(m_options.profiler, "decode");
+        if (!VideoIO::readFrame(std::cin, format, mask.data()))
+          break;
+      }
+      video.process(mask.data(), distances.data());
+
+      Profiler::ScopedPhase finalizePhase(m_options.profiler, "finalize");
+      encodeDistances(distances.data(), format.width, format.height,
+                      output.data(), m_options.metric, m_options.maxDistance);
+      finalizePhase.stop();
+
+      Profiler::ScopedPhase encodePhase(m_options.profiler, "encode");
+      VideoIO::writeFrame(std::cout, format, output.data());
+    }
+  }
+
+private:
+  const VideoIO::Format m_format;
+  const EucliGPU::Options m_options;
+};
+
+/**
+ * \brief Aplica uma operação morfológica por um disco a uma imagem e grava a
+ * máscara resultante em result.bmp.
+*/
+class ExecuteMorphology {
+public:
+  ExecuteMorphology(const std::string &filename,
+                    const EucliGPU::Morphology operation, const float radius,
+                    const EucliGPU::Options &options)
+      : m_filename(filename), m_operation(operation), m_radius(radius),
+        m_options(options){};
+
+  void execute() {
+    int imageWidth, imageHeight;
+    Profiler::ScopedPhase decodePhase(m_options.profiler, "decode");
+    unsigned char *image = stbi_load(m_filename.c_str(), &imageWidth,
+                                     &imageHeight, nullptr, 1);
+    if (image == nullptr)
+      throw std::runtime_error("The image could not be loaded, please check if "
+                               "the filename is corrected");
+    std::vector<unsigned char> mask(image, image + imageWidth * imageHeight);
+    stbi_image_free(image);
+    decodePhase.stop();
+
+    std::vector<unsigned char> output(mask.size());
+    EucliGPU::computeMorphology(mask.data(), imageWidth, imageHeight,
+                                m_operation, m_radius, m_options,
+                                output.data());
+
+    Profiler::ScopedPhase encodePhase(m_options.profiler, "encode");
+    stbi_write_bmp("result.bmp", imageWidth, imageHeight, 1, output.data());
+  }
+
+private:
+  const std::string m_filename;
+  const EucliGPU::Morphology m_operation;
+  const float m_radius;
+  const EucliGPU::Options m_options;
+};
+
+/**
+ * \brief Extrai o esqueleto de uma imagem e grava em result.bmp as distâncias
+ * dos seus pixels, normalizadas como as da transformada.
+*/
+class ExecuteSkeleton {
+public:
+  ExecuteSkeleton(const std::string &filename, const float minFeatureDistance,
+                  const EucliGPU::Options &options)
+      : m_filename(filename), m_minFeatureDistance(minFeatureDistance),
+        m_options(options){};
+
+  void execute() {
+    int imageWidth, imageHeight;
+    Profiler::ScopedPhase decodePhase(m_options.profiler, "decode");
+    unsigned char *image = stbi_load(m_filename.c_str(), &imageWidth,
+                                     &imageHeight, nullptr, 1);
+    if (image == nullptr)
+      throw std::runtime_error("The image could not be loaded, please check if "
+                               "the filename is corrected");
+    std::vector<unsigned char> mask(image, image + imageWidth * imageHeight);
+    stbi_image_free(image);
+    decodePhase.stop();
+
+    std::vector<float> distances(mask.size());
+    EucliGPU::computeSkeleton(mask.data(), imageWidth, imageHeight,
+                              m_minFeatureDistance, m_options,
+                              distances.data());
+
+    Profiler::ScopedPhase finalizePhase(m_options.profiler, "finalize");
+    std::vector<unsigned char> output(mask.size());
+    encodeDistances(distances.data(), imageWidth, imageHeight, output.data(),
+                    m_options.metric, m_options.maxDistance);
+    finalizePhase.stop();
+
+    Profiler::ScopedPhase encodePhase(m_options.profiler, "encode");
+    stbi_write_bmp("result.bmp", imageWidth, imageHeight, 1, output.data());
+  }
+
+private:
+  const std::string m_filename;
+  const float m_minFeatureDistance;
+  const EucliGPU::Options m_options;
+};
+
+/**
+ * \brief Expande os rótulos de uma imagem de 8 ou 16 bits. As distâncias vão
+ * para result.bmp, como na transformada, e os rótulos mais próximos para
+ * labels.pgm, com 16 bits, que o stb não grava em PNG. Com instances, os
+ * rótulos são instâncias, e result.bmp recebe a transformada interior de cada
+ * uma, sem labels.pgm.
+*/
+class ExecuteLabelDT {
+public:
+  ExecuteLabelDT(const std::string &filename, const bool instances,
+                 const EucliGPU::Options &options)
+      : m_filename(filename), m_instances(instances), m_options(options){};
+
+  void execute() {
+    int imageWidth, imageHeight;
+    Profiler::ScopedPhase decodePhase(m_options.profiler, "decode");
+    stbi_us *image = stbi_load_16(m_filename.c_str(), &imageWidth,
+                                  &imageHeight, nullptr, 1);
+    if (image == nullptr)
+      throw std::runtime_error("The image could not be loaded, please check if "
+                               "the filename is corrected");
+    const size_t imageSize = static_cast<size_t>(imageWidth) * imageHeight;
+    std::vector<uint16_t> labels(image, image + imageSize);
+    stbi_image_free(image);
+    decodePhase.stop();
+
+    std::vector<float> distances(imageSize);
+    std::vector<uint16_t> nearestLabels;
+    if (m_instances) {
+      EucliGPU::computeInstanceEDT(labels.data(), imageWidth, imageHeight,
+                                   m_options, distances.data());
+    } else {
+      nearestLabels.resize(imageSize);
+      EucliGPU::computeLabelEDT(labels.data(), imageWidth, imageHeight,
+                                m_options, distances.data(),
+                                nearestLabels.data());
+    }
+
+    Profiler::ScopedPhase finalizePhase(m_options.profiler, "finalize");
+    std::vector<unsigned char> output(imageSize);
+    encodeDistances(distances.data(), imageWidth, imageHeight, output.data(),
+                    m_options.metric, m_options.maxDistance);
+    finalizePhase.stop();
+
+    Profiler::ScopedPhase encodePhase(m_options.profiler, "encode");
+    stbi_write_bmp("result.bmp", imageWidth, imageHeight, 1, output.data());
+    if (m_instances)
+      return;
+    // O PGM de 16 bits guarda cada amostra em big-endian.
+    std::ofstream pgm("labels.pgm", std::ios::binary);
+    pgm << "P5\n" << imageWidth << " " << imageHeight << "\n65535\n";
+    for (const uint16_t label : nearestLabels) {
+      const char bytes[2] = {static_cast<char>(label >> 8),
+                             static_cast<char>(label & 0xff)};
+      pgm.write(bytes, 2);
+    }
+    if (!pgm)
+      throw std::runtime_error("Could not write labels.pgm");
+  }
+
+private:
+  const std::string m_filename;
+  const bool m_instances;
+  const EucliGPU::Options m_options;
+};
+
+// Daemon encerrado pelos sinais de término, veja stopDaemon.
+EucliGPU::Daemon *runningDaemon = nullptr;
+
+void stopDaemon(int) {
+  if (runningDaemon != nullptr)
+    runningDaemon->stop();
+}
+
+/**
+ * \brief Atende requisições pelo socket Unix até receber SIGINT ou SIGTERM. As
+ * requisições FILE leem a máscara com o stb_image e gravam o resultado em BMP,
+ * codificado como o result.bmp.
+*/
+void runDaemon(const std::string &socketPath,
+               const EucliGPU::DeviceOptions &deviceOptions) {
+  EucliGPU::Daemon daemon(
+      socketPath,
+      [](const std::string &path, unsigned int &width, unsigned int &height) {
+        int imageWidth, imageHeight;
+        unsigned char *image =
+            stbi_load(path.c_str(), &imageWidth, &imageHeight, nullptr, 1);
+        if (image == nullptr)
+          throw std::runtime_error("The image " + path + " could not be loaded");
+        width = imageWidth;
+        height = imageHeight;
+        std::vector<uint8_t> mask(image, image + imageWidth * imageHeight);
+        stbi_image_free(image);
+        return mask;
+      },
+      [](const std::string &path, const float *distances,
+         const unsigned int width, const unsigned int height,
+         const EucliGPU::Metric metric) {
+        std::vector<unsigned char> output(static_cast<size_t>(width) * height);
+        encodeDistances(distances, width, height, output.data(), metric);
+        if (!stbi_write_bmp(path.c_str(), width, height, 1, output.data()))
+          throw std::runtime_error("The image " + path + " could not be written");
+      },
+      deviceOptions);
+  runningDaemon = &daemon;
+  std::signal(SIGINT, stopDaemon);
+  std::signal(SIGTERM, stopDaemon);
+  std::clog << "Listening on " << socketPath << "\n";
+  daemon.run();
+  runningDaemon = nullptr;
+
+  const EucliGPU::LatencyStats stats = daemon.latencies();
+  std::clog << stats.count << " requests, latency p50 " << stats.p50
+            << " ms, p95 " << stats.p95 << " ms, p99 " << stats.p99 << " ms\n";
+}
+
 int main(int argc, char const *argv[]) {
-  if (argc < 2) {
+  std::vector<std::string> filenames;
+  EucliGPU::Options options;
+  std::string obstaclesFilename;
+  bool profile = false;
+  bool autotune = false;
+  bool video = false;
+  bool morphology = false;
+  EucliGPU::Morphology morphologyOperation = EucliGPU::Morphology::Erode;
+  float radius = 1;
+  bool skeleton = false;
+  bool labels = false;
+  bool instances = false;
+  float minFeatureDistance = 1;
+  std::string socketPath;
+  VideoIO::Format videoFormat;
+  Profiler::Format profileFormat = Profiler::Format::Text;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--engine" && i + 1 < argc) {
+      options.engine = EucliGPU::parseEngine(argv[++i]);
+    } else if (arg == "--obstacles" && i + 1 < argc) {
+      obstaclesFilename = argv[++i];
+    } else if (arg == "--metric" && i + 1 < argc) {
+      options.metric = EucliGPU::parseMetric(argv[++i]);
+    } else if (arg == "--max-distance" && i + 1 < argc) {
+      options.maxDistance = std::stof(argv[++i]);
+    } else if (arg == "--morphology" && i + 1 < argc) {
+      morphology = true;
+      morphologyOperation = EucliGPU::parseMorphology(argv[++i]);
+    } else if (arg == "--radius" && i + 1 < argc) {
+      radius = std::stof(argv[++i]);
+    } else if (arg == "--labels") {
+      labels = true;
+    } else if (arg == "--instances") {
+      instances = true;
+    } else if (arg == "--skeleton") {
+      skeleton = true;
+    } else if (arg == "--prune" && i + 1 < argc) {
+      minFeatureDistance = std::stof(argv[++i]);
+    } else if (arg == "--profile") {
+      profile = true;
+    } else if (arg == "--profile=json") {
+      profile = true;
+      profileFormat = Profiler::Format::JSON;
+    } else if (arg == "--autotune") {
+      autotune = true;
+    } else if (arg == "--daemon" && i + 1 < argc) {
+      socketPath = argv[++i];
+    } else if (arg == "--video") {
+      video = true;
+      videoFormat.y4m = true;
+    } else if (arg.compare(0, 8, "--video=") == 0) {
+      // Quadros brutos com o tamanho LARGURAxALTURA.
+      unsigned int width = 0, height = 0;
+      if (std::sscanf(arg.c_str() + 8, "%ux%u", &width, &height) != 2 ||
+          width == 0 || height == 0) {
+        std::cerr << "Invalid video frame size " << arg.substr(8) << std::endl;
+        return -1;
+      }
+      video = true;
+      videoFormat = VideoIO::raw(width, height);
+    } else {
+      filenames.push_back(arg);
+    }
+  }
+
+  if (autotune) {
+    // Ajusta todos os dispositivos e salva os perfis usados nas próximas
+    // execuções.
+    for (const cl::Device &device : OpenCLUtils::getDevices()) {
+      std::clog << "Tuning " << device.getInfo<CL_DEVICE_NAME>() << "\n";
+      const OpenCLUtils::LaunchConfig config =
+          Autotuner::autotune(device, &std::clog);
+      Autotuner::saveProfile(device, config);
+      std::clog << "Best: local " << config.localSize << ", items "
+                << config.itemsPerWorkItem << ", queue "
+                << config.queueCapacity << ", saved to "
+                << Autotuner::profilePath() << "\n";
+    }
+    if (filenames.empty())
+      return 0;
+  }
+
+  // O executável usa os perfis salvos por --autotune e informa no clog os
+  // dispositivos usados, o que a biblioteca só faz a pedido.
+  EucliGPU::DeviceOptions deviceOptions;
+  deviceOptions.loadProfile = true;
+  deviceOptions.log = &std::clog;
+
+  if (!socketPath.empty()) {
+    runDaemon(socketPath, deviceOptions);
+    return 0;
+  }
+
+  if (video) {
+    // A saída padrão recebe os quadros, então o perfil vai para o clog.
+    Profiler profiler;
+    if (profile)
+      options.profiler = &profiler;
+    std::unique_ptr<EucliGPU::Context> context;
+    if (options.engine == EucliGPU::Engine::OpenCL) {
+      context.reset(new EucliGPU::Context(0, deviceOptions));
+      options.context = context.get();
+    }
+    ExecuteVideoDT exec(videoFormat, options);
+    exec.execute();
+    if (profile)
+      profiler.print(std::clog, profileFormat);
+    return 0;
+  }
+
+  if (filenames.empty()) {
     std::cerr
         << "You have to pass 1 argument to the program, but none was passed."
+        << std::endl
+        << "Usage: " << argv[0]
+        << " [--engine opencl|cpu|exact] [--metric euclidean|squared|cityblock|"
+           "chessboard|chamfer34|chamfer5711] [--max-distance <pixels>]"
+           " [--obstacles <image>]"
+        << " [--profile | --profile=json]"
+        << " [--autotune] <image> [<image> ...]"
+        << std::endl
+        << "       " << argv[0]
+        << " --video | --video=<width>x<height> [--metric ...] [--profile]"
+           " < masks > distances"
+        << std::endl
+        << "       " << argv[0]
+        << " --morphology erode|dilate|open|close [--radius <pixels>]"
+           " [--engine ...] [--metric ...] <image>"
+        << std::endl
+        << "       " << argv[0]
+        << " --skeleton [--prune <pixels>] [--engine opencl|cpu] [--metric ...]"
+           " <image>"
+        << std::endl
+        << "       " << argv[0]
+        << " --labels | --instances [--engine opencl|cpu] [--metric ...]"
+           " <label image>"
+        << std::endl
+        << "       " << argv[0] << " --daemon <socket>"
         << std::endl;
     return -1;
   }
 
-  const std::string filename(argv[1]);
-
+  Profiler profiler;
   try {
     // Executa com o destrutor seguro para desalocar todos os ponteiros criados.
-    ExecuteDT exec(filename);
-    exec.execute();
+    if (profile)
+      options.profiler = &profiler;
+    if (filenames.size() > 1 && !obstaclesFilename.empty())
+      throw std::runtime_error("Obstacles are only supported with one image");
+    if ((morphology || skeleton || labels || instances) &&
+        (filenames.size() > 1 || !obstaclesFilename.empty()))
+      throw std::runtime_error("Morphology, the skeleton and labels take a "
+                               "single image, without obstacles");
+    // Várias imagens vão para o Scheduler, que prepara todos os dispositivos.
+    std::unique_ptr<EucliGPU::Context> context;
+    if (options.engine == EucliGPU::Engine::OpenCL && filenames.size() == 1) {
+      Profiler::ScopedPhase setupPhase(options.profiler, "setup");
+      context.reset(new EucliGPU::Context(0, deviceOptions));
+      options.context = context.get();
+    }
+    if (morphology) {
+      ExecuteMorphology exec(filenames[0], morphologyOperation, radius,
+                             options);
+      exec.execute();
+    } else if (skeleton) {
+      ExecuteSkeleton exec(filenames[0], minFeatureDistance, options);
+      exec.execute();
+    } else if (labels || instances) {
+      ExecuteLabelDT exec(filenames[0], instances, options);
+      exec.execute();
+    } else if (filenames.size() > 1 &&
+               options.engine == EucliGPU::Engine::OpenCL) {
+      ExecuteBatchDT exec(filenames, options, deviceOptions);
+      exec.execute();
+    } else {
+      if (filenames.size() > 1)
+        throw std::runtime_error("Several images are only supported by the "
+                                 "opencl engine");
+      ExecuteDT exec(filenames[0], options, obstaclesFilename);
+      exec.execute();
+    }
   } catch (const std::runtime_error &e) {
     throw e;
   }
 
+  if (profile)
+    profiler.print(std::cout, profileFormat);
+
   return 0;
 }
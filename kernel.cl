@@ -10,19 +10,100 @@ uint4 constructCoord(unsigned int y, unsigned int x, unsigned int imageWidth) {
   return coord;
 }
 
+/**
+ * \brief Posição do pixel coord nos buffers de uma imagem com width colunas.
+ * Com -DTILE_SIZE=n, os buffers da propagação ficam em blocos de n x n pixels,
+ * em ordem de linhas dentro do bloco e entre os blocos, e os vizinhos de cima
+ * e de baixo ficam quase sempre no mesmo bloco, em vez de uma linha inteira
+ * adiante. Sem, é o índice em ordem de linhas de constructCoord. As
+ * coordenadas, e portanto os fundos no diagrama, não mudam com o layout.
+*/
+uint pixelIndex(const uint4 coord, const uint width) {
+#ifdef TILE_SIZE
+  const uint tilesPerRow = (width + TILE_SIZE - 1) / TILE_SIZE;
+  const uint tile = (coord.y / TILE_SIZE) * tilesPerRow + coord.x / TILE_SIZE;
+  return tile * (TILE_SIZE * TILE_SIZE) + (coord.y % TILE_SIZE) * TILE_SIZE + coord.x % TILE_SIZE;
+#else
+  return coord.z;
+#endif
+}
+
 uint4 constructInvalidCoord() {
-  const unsigned int maxUInt = INFINITY;
-  uint4 coord;
-  coord.y = maxUInt;
-  coord.x = maxUInt;
-  return coord;
+  return (uint4)(UINT_MAX, UINT_MAX, UINT_MAX, UINT_MAX);
+}
+
+// Métrica comparada na propagação, escolhida na compilação com -DMETRIC=n. Os
+// valores seguem a ordem de EucliGPU::Metric, e as fórmulas são as mesmas do
+// Metrics.hpp. Todas comparam inteiros; a euclidiana compara o quadrado da
+// distância, exato em 64 bits, e só metricValue tira a raiz.
+#define METRIC_EUCLIDEAN 0
+#define METRIC_SQUARED 1
+#define METRIC_CITY_BLOCK 2
+#define METRIC_CHESSBOARD 3
+#define METRIC_CHAMFER_3_4 4
+#define METRIC_CHAMFER_5_7_11 5
+
+#ifndef METRIC
+#define METRIC METRIC_EUCLIDEAN
+#endif
+
+typedef ulong distance_t;
+
+/**
+ * \brief Com as coordenadas de uma imagem de até 2^32 pixels, nenhuma das
+ * fórmulas passa de 64 bits.
+*/
+distance_t metricDistance(const uint4 coord1, const uint4 coord2) {
+  const ulong dx = abs_diff(coord1.x, coord2.x);
+  const ulong dy = abs_diff(coord1.y, coord2.y);
+  const ulong a = max(dx, dy);
+  const ulong b = min(dx, dy);
+#if METRIC == METRIC_EUCLIDEAN || METRIC == METRIC_SQUARED
+  return a * a + b * b;
+#elif METRIC == METRIC_CITY_BLOCK
+  return a + b;
+#elif METRIC == METRIC_CHESSBOARD
+  return a;
+#elif METRIC == METRIC_CHAMFER_3_4
+  return 3 * a + b;
+#elif METRIC == METRIC_CHAMFER_5_7_11
+  return a >= 2 * b ? 5 * a + b : 4 * a + 3 * b;
+#else
+#error Unknown METRIC
+#endif
 }
 
 /**
- * \brief Calcula a distância euclideana.
+ * \brief Distância na escala de saída: os pesos do chamfer são normalizados
+ * pelo passo ortogonal, como Metrics::value.
 */
-float euclideanDistance(const uint4 coord1, const uint4 coord2) {
-  return sqrt(((float) coord1.y - coord2.y)*((float) coord1.y - coord2.y) + ((float) coord1.x - coord2.x)*((float) coord1.x - coord2.x));
+float metricValue(const distance_t distance) {
+#if METRIC == METRIC_EUCLIDEAN
+  return sqrt((float) distance);
+#elif METRIC == METRIC_CHAMFER_3_4
+  return distance / 3.0f;
+#elif METRIC == METRIC_CHAMFER_5_7_11
+  return distance / 5.0f;
+#else
+  return distance;
+#endif
+}
+
+/**
+ * \brief Se area está mais perto de q que current, e dentro da faixa band. Um
+ * pixel sem fundo mais próximo (coordenada inválida) está infinitamente longe,
+ * sem passar pela fórmula, que estouraria com as métricas inteiras. Entre
+ * fundos à mesma distância, fica o de menor índice, e o empate não depende de
+ * qual work-item chega primeiro.
+*/
+bool closer(const uint4 q, const uint4 area, const uint4 current, const distance_t band) {
+  const distance_t candidate = metricDistance(q, area);
+  if (candidate > band)
+    return false;
+  if (current.x == UINT_MAX)
+    return true;
+  const distance_t distance = metricDistance(q, current);
+  return candidate < distance || (candidate == distance && area.z < current.z);
 }
 
 /**
@@ -38,30 +119,31 @@ uint4 constructPixel(const uint4 coord, const uint value) {
   return pixel;
 }
 
-typedef struct {
-  // Há no máximo 8 vizinhos.
-  uint4 pixels[8];
-  // É unsigned char pois pode representar no máximo 8, então não é necessário
-  // mais de um byte.
-  ushort size;
-  
-} Neighborhood;
-
-Neighborhood initNeighborhood() {
-  Neighborhood neighborhood;
-  neighborhood.size = 0;
-
-  return neighborhood;
-}
-
-void addNeighbor(Neighborhood *neighborhood, uint4 pixel) {
-  neighborhood->pixels[neighborhood->size++] = pixel;
-}
+#define NEIGHBOR_COUNT 8
 
-uint4 getNeighbor(const Neighborhood neighborhood, const unsigned char index) {
-  const uint4 pixel = neighborhood.pixels[index];
+/**
+ * \brief Deslocamentos (x, y) dos vizinhos na janela 3x3, em ordem de linhas e
+ * sem o centro. O índice de um vizinho na tabela é também o seu bit na máscara
+ * de vizinhos do mesmo rótulo de instanceSeeds. Os laços de 0 a NEIGHBOR_COUNT
+ * são desenrolados pelo compilador, e cada vizinho é calculado na hora, sem
+ * uma lista de vizinhos na memória privada.
+*/
+__constant int2 neighborOffsets[NEIGHBOR_COUNT] = {
+  (int2)(-1, -1), (int2)(0, -1), (int2)(1, -1),
+  (int2)(-1, 0),                 (int2)(1, 0),
+  (int2)(-1, 1),  (int2)(0, 1),  (int2)(1, 1)
+};
 
-  return pixel;
+/**
+ * \brief Coordenada em neighbor do vizinho k de pixel, numa imagem com attrs.
+ * Retorna falso se ele está fora da imagem: x e y são sem sinal, então o -1 da
+ * coluna ou da linha 0 dá a volta e também passa da borda.
+*/
+bool neighborCoord(const uint4 pixel, const uint2 attrs, const int k, uint4 *neighbor) {
+  const uint x = pixel.x + neighborOffsets[k].x;
+  const uint y = pixel.y + neighborOffsets[k].y;
+  *neighbor = constructCoord(y, x, attrs.x);
+  return x < attrs.x && y < attrs.y;
 }
 
 /*
@@ -84,51 +166,43 @@ UCImage constructUCImage(unsigned char *image, const unsigned int height, const
 */
 
 uchar getValueByCoord(const __global unsigned char *image, const uint2 attrs, const uint4 coord) {
-  return image[coord.y * attrs.x + coord.x];
+  return image[pixelIndex(coord, attrs.x)];
 }
 
 bool isBackgroudByCoord(const __global unsigned char *image, const uint2 attrs, const uint4 coord) {
   return getValueByCoord(image, attrs, coord) == 0;
 }
 
-uint4 getPixel(const __global unsigned char *image, const uint2 attrs, const uint4 coordinate) {
-  return constructPixel(coordinate, isBackgroudByCoord(image, attrs, coordinate));
-}
-
-uint4 getPixelByCoord(const __global unsigned char *image, const uint2 attrs, int y, int x) {
-  const uint4 coord = constructCoord(y, x, attrs.x);
-  return getPixel(image, attrs, coord);
-}
-
-bool isBackgroudByPixel(const uint4 pixel) {
-  return pixel.w;
-}
-
 /**
- * \brief Retorna a lista de valores vizinhos ao pixel na imagem.
- * A vizinhança utilizada é a simples, vizinhança direta na janela 3x3.
+ * \brief Com -DMASK_IMAGE, a máscara da propagação é um image2d_t de uma só
+ * imagem, em vez de um buffer, lido com maskSampler, e os vizinhos são
+ * percorridos sem os testes de borda. MASK_ARG é o tipo do argumento da máscara
+ * nos dois casos.
 */
-Neighborhood getNeighborhood(const __global unsigned char *image, const uint2 attrs, const uint4 pixel) {
-  Neighborhood neighborhood;
-  neighborhood.size = 0;
-  for (int i = -1; i < 2; i++) {
-    const uint y = pixel.y - i;
-    if (y >= attrs.y)
-      continue;
+#ifdef MASK_IMAGE
+#ifdef INSTANCES
+#error "MASK_IMAGE holds a plain mask and does not support INSTANCES"
+#endif
+#define MASK_ARG read_only image2d_t
 
-    for (int j = -1; j < 2; j++) {
-      if (j == 0 && i == 0)
-        continue;
-      const uint x = pixel.x - j;
-      if (x < 0 || x >= attrs.x)
-        continue;
+// Fora da imagem, repete o pixel da borda, o mesmo de clampedNeighborCoord.
+__constant sampler_t maskSampler =
+    CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 
-      addNeighbor(&neighborhood, getPixelByCoord(image, attrs, y, x));
-    }
-  }
-  
-  return neighborhood;
+/**
+ * \brief Vizinho k de pixel com a coordenada fixada na borda da imagem, como o
+ * endereçamento clamp-to-edge de um sampler, sem desvios. O vizinho repetido é
+ * o próprio pixel ou outro vizinho, e relaxá-lo de novo não muda nada, porque
+ * closer só troca o fundo por um estritamente mais próximo.
+*/
+uint4 clampedNeighborCoord(const uint4 pixel, const uint2 attrs, const int k) {
+  const int2 at = clamp((int2)((int)pixel.x, (int)pixel.y) + neighborOffsets[k],
+                        (int2)(0, 0), (int2)((int)attrs.x - 1, (int)attrs.y - 1));
+  return constructCoord(at.y, at.x, attrs.x);
 }
+#else
+#define MASK_ARG __global const unsigned char *
+#endif
 
 typedef struct {
   uint4 point;
@@ -144,31 +218,34 @@ typedef struct {
 } VoronoiDiagramMap;
 */
 
-int get_hash(__global const VoronoiDiagramMapEntry *map, const unsigned int diagramSize, const uint4 key) {
-  // Pega o valor do indice da coordenada.
-  return (key.z %diagramSize);
-}
-
-__global VoronoiDiagramMapEntry *getVoronoiEntry(__global VoronoiDiagramMapEntry *map, const unsigned int diagramSize, const uint4 pixel) {
-  return &map[get_hash(map, diagramSize, pixel)];
-}
-
-uint4 getVoronoiValue(__global VoronoiDiagramMapEntry *map, const unsigned int diagramSize, const uint4 pixel) {
-  return getVoronoiEntry(map, diagramSize, pixel)->nearestBackground;
-}
-
-volatile __global uint4 *getVoronoiValuePtr(__global VoronoiDiagramMapEntry *map, const unsigned int diagramSize, const uint4 pixel) {
-  return &(getVoronoiEntry(map, diagramSize, pixel)->nearestBackground);
-}
-
 bool compareCoords(const uint4 coord1, const uint4 coord2) {
   return coord1.y == coord2.y && coord1.x == coord2.x && coord1.z == coord2.z;
 }
 
+// Capacidade da fila circular privada de cada work-item, sem contar o cabeçalho.
+// Pode ser definida na compilação do programa (-DQUEUE_CAPACITY=n) pelo autotuner.
+#ifndef QUEUE_CAPACITY
+#define QUEUE_CAPACITY 64
+#endif
+
+#ifdef EDT_STATS
+// Índices dos contadores no buffer de estatísticas, devem ser os mesmos de
+// OpenCLUtils::PropagationStat.
+#define STAT_PIXELS 0
+#define STAT_UPDATES 1
+#define STAT_CAS_RETRIES 2
+#define STAT_QUEUE_OVERFLOWS 3
+#define STAT_COUNT 4
+#define STAT_INC(counters, counter) ((counters)[counter]++)
+#else
+#define STAT_COUNT 1
+#define STAT_INC(counters, counter)
+#endif
+
 bool push(__private uint4 *stack, uint4 value) {
   // pushing from bot, so you can pop it from top later (FIFO)
   // circular buffer for top performance
-  uint bufLen=64;
+  uint bufLen=QUEUE_CAPACITY;
   // zeroth element is counter for newest added element
   // first element is oldest element
 
@@ -194,11 +271,11 @@ bool empty(__private uint4 * stack) {
 }
 
 uint size(__private uint4 *stack) {
-  return (stack[0].y - stack[0].x);
+  return (stack[0].x - stack[0].y);
 }
 
 uint4 front(__private uint4 *stack) {
-  uint bufLen=64;
+  uint bufLen=QUEUE_CAPACITY;
 
   // oldest element value (top)
   uint ptr=stack[0].y%bufLen+1; // circular adr + 1 header
@@ -208,7 +285,7 @@ uint4 front(__private uint4 *stack) {
 }
 
 uint4 pop(__private uint4 *stack) {
-  uint bufLen=64;
+  uint bufLen=QUEUE_CAPACITY;
   uint ptr=stack[0].y%bufLen+1;
   // pop from top (oldest)
   uint4 returnValue=stack[ptr];
@@ -229,80 +306,599 @@ uint4 cmpxchg(volatile __global uint4* p, uint4 cmp, uint4 val) {
   return old;
 }
 
-void __kernel euclidean(
-  __global const unsigned char *image,
-  const uint2 imageAttrs,
-  __global uint4 *pixelQueue,
-  const unsigned int pixelQueueSize,
+/**
+ * \brief Fronteira da próxima rodada, em memória global. Recebe os pixels que
+ * não cabem na fila privada, em vez de sobrescrever os mais antigos.
+*/
+typedef struct {
+  __global uint4 *pixels;
+  volatile __global uint *size;
+  // Rodada em que cada pixel entrou pela última vez na fronteira, para que um
+  // pixel atualizado por vários work-items entre uma única vez por rodada.
+  volatile __global uint *stamps;
+  uint round;
+} Frontier;
+
+/**
+ * \brief stamp é a posição de q nos carimbos, a mesma dos seus buffers.
+*/
+void spill(Frontier *next, const uint stamp, const uint4 q) {
+  if (atomic_xchg(&next->stamps[stamp], next->round) != next->round)
+    next->pixels[atomic_inc(next->size)] = q;
+}
+
+/**
+ * \brief Propaga a área do pixel p para os seus vizinhos, enfileirando os vizinhos
+ * que tiveram o pixel mais próximo atualizado. Com a fila privada cheia, os
+ * vizinhos vão para a fronteira da próxima rodada. Um vizinho mais distante da
+ * área que band não é atualizado, o que encerra a frente de onda na faixa.
+ * As imagens do lote estão concatenadas em images e voronoi; p.w é o índice da
+ * imagem de p na imageTable, cuja entrada tem o deslocamento da imagem em x, a
+ * largura e altura em y e z e, em w, a primeira linha da imagem numa imagem
+ * maior, quando ela é uma faixa propagada em partes. As coordenadas dos pixels
+ * são relativas à faixa, e as dos fundos, à imagem inteira.
+ * Os vizinhos só precisam das coordenadas, e a máscara no buffer images não é
+ * lida: um fundo é o próprio fundo mais próximo, e closer nunca o troca.
+ * Com -DINSTANCES, images tem em cada pixel a máscara dos vizinhos com o mesmo
+ * rótulo, de instanceSeeds: p propaga o seu fundo só a esses, e é ele próprio
+ * o fundo dos vizinhos de outra instância.
+ * Com -DMASK_IMAGE, images é o image2d_t da máscara de uma única imagem, os
+ * vizinhos vêm de clampedNeighborCoord e os de fundo, lidos com maskSampler,
+ * são pulados.
+*/
+void relaxNeighborhood(
+  MASK_ARG images,
+  __global const uint4 *imageTable,
   __global VoronoiDiagramMapEntry *voronoi,
-  const unsigned int voronoiSize
+  const uint4 p,
+  const distance_t band,
+  __private uint4 *exceededPixel,
+  Frontier *next,
+  __private uint *counters
 ) {
-  //printf("PixelQueueSize: %d\n", pixelQueueSize);
-  // Wavefront propagation
-  __local unsigned int localPixelQueueOffset;
-  __local unsigned int localPixelQueueSize;
-  if (get_group_id(0) == 0) {
-    localPixelQueueOffset = 0;
-    localPixelQueueSize = 
-      (pixelQueueSize/get_num_groups(0)) + (pixelQueueSize%get_num_groups(0));
-  } else {
-    localPixelQueueOffset = 
-      get_group_id(0)*(pixelQueueSize/get_num_groups(0)) + (pixelQueueSize%get_num_groups(0));
-    localPixelQueueSize = (pixelQueueSize/get_num_groups(0));
+  STAT_INC(counters, STAT_PIXELS);
+  const uint4 imageEntry = imageTable[p.w];
+  const uint offset = imageEntry.x;
+  const uint2 imageAttrs = imageEntry.yz;
+  __global VoronoiDiagramMapEntry *imageVoronoi = voronoi + offset;
+  const uint rowOrigin = imageEntry.w;
+
+  const uint pIndex = pixelIndex(p, imageAttrs.x);
+  const uint4 nearest = imageVoronoi[pIndex].nearestBackground;
+#ifdef INSTANCES
+  const uchar sameLabel = images[offset + pIndex];
+  const uint4 boundary = constructCoord(p.y + rowOrigin, p.x, imageAttrs.x);
+#endif
+#pragma unroll
+  for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+#ifdef MASK_IMAGE
+    // Um fundo é o próprio fundo mais próximo, e closer nunca o troca: a
+    // leitura de um byte pelo sampler evita a do diagrama, de 16 bytes.
+    const int2 at = (int2)((int)p.x, (int)p.y) + neighborOffsets[k];
+    if (read_imageui(images, maskSampler, at).x == 0)
+      continue;
+    uint4 q = clampedNeighborCoord(p, imageAttrs, k);
+#else
+    uint4 q;
+    if (!neighborCoord(p, imageAttrs, k, &q))
+      continue;
+#endif
+    // O vizinho herda a imagem de p.
+    q.w = p.w;
+#ifdef INSTANCES
+    const uint4 area = (sameLabel >> k) & 1 ? nearest : boundary;
+    // Um pixel da fronteira inicial só é borda das outras instâncias até a
+    // propagação da sua chegar a ele.
+    if (area.x == UINT_MAX)
+      continue;
+#else
+    const uint4 area = nearest;
+#endif
+    const uint qIndex = pixelIndex(q, imageAttrs.x);
+    volatile __global uint4 *voronoiValuePtr = &imageVoronoi[qIndex].nearestBackground;
+    uint4 curVRQ = *voronoiValuePtr;
+    // q na imagem inteira, para medir a distância aos fundos.
+    uint4 imageQ = q;
+    imageQ.y += rowOrigin;
+    do {
+      if (closer(imageQ, area, curVRQ, band)) {
+        uint4 old = cmpxchg(voronoiValuePtr, curVRQ, area);
+        if (compareCoords(old, curVRQ)) {
+          STAT_INC(counters, STAT_UPDATES);
+          if (size(exceededPixel) >= QUEUE_CAPACITY) {
+            STAT_INC(counters, STAT_QUEUE_OVERFLOWS);
+            spill(next, offset + qIndex, q);
+          } else {
+            push(exceededPixel, q);
+          }
+          break;
+        }
+        // Outro work-item alterou o valor, compara novamente com o valor atual.
+        STAT_INC(counters, STAT_CAS_RETRIES);
+        curVRQ = old;
+      } else break;
+    } while (true);
   }
+}
 
-  __private unsigned int privatePixelQueueOffset = get_local_id(0)*(localPixelQueueSize/get_local_size(0));
-  __private unsigned int privatePixelQueueSize = get_local_id(0) != (get_local_size(0) - 1) ? 
-    (localPixelQueueSize/get_local_size(0)) 
-    : 
-    (localPixelQueueSize/get_local_size(0)) + (localPixelQueueSize%get_local_size(0));
-  
-  uint exceededPixelSize = 0;
-  // o máximo de pixel excedido é a quantidade de pixels multiplicado pelo valor máximo de vizinhos
-  // q cada píxel pode ter.
-  // Fila circular de pixels excedidos com tamanho máximo de 100, e o primeiro elemento x e y indica o inicio e fim
+/**
+ * \brief Uma rodada da propagação: cada work-item relaxa um bloco contíguo de
+ * itemsPerWorkItem pixels da fronteira e continua pela sua fila privada. O host
+ * lança rodadas enquanto a fronteira seguinte não estiver vazia, com o NDRange
+ * proporcional a ela.
+ * Várias imagens são processadas no mesmo lançamento: cada pixel da fronteira
+ * leva em w o índice da sua imagem na imageTable.
+ * A propagação para em band, a maior distância na escala da métrica dentro da
+ * maxDistance, calculada no host por Metrics::bandLimit com a mesma aritmética
+ * das engines do host; os pixels mais distantes ficam com a coordenada
+ * inválida.
+*/
+void __kernel euclidean(
+  MASK_ARG images,
+  __global const uint4 *imageTable,
+  __global const uint4 *frontier,
+  const unsigned int frontierSize,
+  const unsigned int itemsPerWorkItem,
+  __global VoronoiDiagramMapEntry *voronoi,
+  __global uint4 *nextFrontier,
+  volatile __global uint *nextFrontierSize,
+  volatile __global uint *stamps,
+  const unsigned int round,
+  const distance_t band
+#ifdef EDT_STATS
+  , __global uint *stats
+#endif
+) {
+  // O NDRange é arredondado para um múltiplo do work-group, então os últimos
+  // work-items podem não ter nenhum pixel.
+  const uint frontierBegin = get_global_id(0) * itemsPerWorkItem;
+  if (frontierBegin >= frontierSize)
+    return;
+  const uint frontierEnd = min(frontierBegin + itemsPerWorkItem, frontierSize);
+
+  // Fila circular de pixels excedidos com capacidade QUEUE_CAPACITY, e o primeiro elemento x e y indica o inicio e fim
   // da fila respectivamente.
-  uint4 exceededPixel[64];
+  uint4 exceededPixel[QUEUE_CAPACITY + 1];
   exceededPixel[0].x = 0;
   exceededPixel[0].y = 0;
 
-  for (int i = 0; i < privatePixelQueueSize; i++) {
-    uint4 p = pixelQueue[localPixelQueueOffset*get_group_id(0)+privatePixelQueueOffset + i];
-    uint4 area = voronoi[p.z].nearestBackground;
-    Neighborhood neighborhood = getNeighborhood(image, imageAttrs, p);
-    for (int j = 0; j < neighborhood.size; j++) {
-      uint4 q = neighborhood.pixels[j];
-      uint4 curVRQ = voronoi[q.z].nearestBackground;
-      volatile __global uint4 *voronoiValuePtr = getVoronoiValuePtr(voronoi, voronoiSize, q);
-      do {
-        if (euclideanDistance(q, area) < euclideanDistance(q, curVRQ)) {
-          uint4 old = cmpxchg(voronoiValuePtr, curVRQ, area);
-          if (compareCoords(old, curVRQ)) {
-            push(exceededPixel, q);
-            break;
-          }
-        } else break;
-      } while (true);
+  Frontier next = {nextFrontier, nextFrontierSize, stamps, round};
+
+  uint counters[STAT_COUNT];
+  for (int i = 0; i < STAT_COUNT; i++)
+    counters[i] = 0;
+
+  for (uint i = frontierBegin; i < frontierEnd; i++) {
+    uint4 p = frontier[i];
+    relaxNeighborhood(images, imageTable, voronoi, p, band, exceededPixel, &next, counters);
+  }
+
+  while(!empty(exceededPixel)) {
+    uint4 p = pop(exceededPixel);
+    relaxNeighborhood(images, imageTable, voronoi, p, band, exceededPixel, &next, counters);
+  }
+
+#ifdef EDT_STATS
+  for (int i = 0; i < STAT_COUNT; i++)
+    if (counters[i] != 0)
+      atomic_add(&stats[i], counters[i]);
+#endif
+}
+
+/**
+ * \brief Copia a máscara, em ordem de linhas, para o layout de pixelIndex. Os
+ * pixels de preenchimento dos blocos da borda não são escritos, e a propagação
+ * nunca os lê. Um work-item por pixel.
+*/
+void __kernel tileMask(
+  __global const unsigned char *mask,
+  const uint2 attrs,
+  __global unsigned char *tiles
+) {
+  const uint i = get_global_id(0);
+  if (i >= attrs.x * attrs.y)
+    return;
+  tiles[pixelIndex(constructCoord(i / attrs.x, i % attrs.x, attrs.x), attrs.x)] = mask[i];
+}
+
+/**
+ * \brief Copia um buffer com words palavras por pixel da ordem de linhas para
+ * o layout de pixelIndex, com toTiles, ou de volta, sem. Um work-item por
+ * pixel.
+*/
+void __kernel convertLayout(
+  __global const uint *source,
+  const uint2 attrs,
+  const uint words,
+  const uint toTiles,
+  __global uint *destination
+) {
+  const uint i = get_global_id(0);
+  if (i >= attrs.x * attrs.y)
+    return;
+  const uint tiled = pixelIndex(constructCoord(i / attrs.x, i % attrs.x, attrs.x), attrs.x);
+  const size_t from = (size_t) (toTiles ? i : tiled) * words;
+  const size_t to = (size_t) (toTiles ? tiled : i) * words;
+  for (uint k = 0; k < words; k++)
+    destination[to + k] = source[from + k];
+}
+
+// Custos de passo da distância geodésica em ponto fixo, com 8 bits de fração:
+// 256 para o passo ortogonal e 256·√2 para o diagonal.
+#define GEODESIC_ORTHOGONAL 256
+#define GEODESIC_DIAGONAL 362
+
+/**
+ * \brief Relaxa o custo acumulado dos vizinhos de p que não são obstáculos,
+ * enfileirando os que diminuíram. Os obstáculos fazem o papel da máscara: um
+ * pixel de valor 0 em obstacles é livre.
+ * Custos acima de maxCost não são propagados.
+*/
+void relaxGeodesic(
+  __global const unsigned char *obstacles,
+  __global const uint4 *imageTable,
+  volatile __global uint *costs,
+  const uint4 p,
+  const uint maxCost,
+  __private uint4 *exceededPixel,
+  Frontier *next,
+  __private uint *counters
+) {
+  STAT_INC(counters, STAT_PIXELS);
+  const uint4 imageEntry = imageTable[p.w];
+  const uint offset = imageEntry.x;
+  const uint2 imageAttrs = imageEntry.yz;
+  volatile __global uint *imageCosts = costs + offset;
+
+  __global const unsigned char *imageObstacles = obstacles + offset;
+
+  const uint cost = imageCosts[p.z];
+#pragma unroll
+  for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+    uint4 q;
+    if (!neighborCoord(p, imageAttrs, k, &q) || imageObstacles[q.z] != 0)
+      continue;
+    q.w = p.w;
+    const uint candidate = cost +
+      (q.x != p.x && q.y != p.y ? GEODESIC_DIAGONAL : GEODESIC_ORTHOGONAL);
+    if (candidate <= maxCost && atomic_min(&imageCosts[q.z], candidate) > candidate) {
+      STAT_INC(counters, STAT_UPDATES);
+      if (size(exceededPixel) >= QUEUE_CAPACITY) {
+        STAT_INC(counters, STAT_QUEUE_OVERFLOWS);
+        spill(next, offset + q.z, q);
+      } else {
+        push(exceededPixel, q);
+      }
     }
   }
+}
+
+/**
+ * \brief Uma rodada da distância geodésica, com os mesmos argumentos e rodadas
+ * do kernel euclidean. No lugar do diagrama de Voronoi, cada pixel guarda o
+ * custo do menor caminho de 8 vizinhos até um fundo, sem atravessar obstáculos.
+ * A faixa é o custo máximo maxCost, em ponto fixo.
+*/
+void __kernel geodesic(
+  __global const unsigned char *obstacles,
+  __global const uint4 *imageTable,
+  __global const uint4 *frontier,
+  const unsigned int frontierSize,
+  const unsigned int itemsPerWorkItem,
+  volatile __global uint *costs,
+  __global uint4 *nextFrontier,
+  volatile __global uint *nextFrontierSize,
+  volatile __global uint *stamps,
+  const unsigned int round,
+  const uint maxCost
+#ifdef EDT_STATS
+  , __global uint *stats
+#endif
+) {
+  const uint frontierBegin = get_global_id(0) * itemsPerWorkItem;
+  if (frontierBegin >= frontierSize)
+    return;
+  const uint frontierEnd = min(frontierBegin + itemsPerWorkItem, frontierSize);
+
+  uint4 exceededPixel[QUEUE_CAPACITY + 1];
+  exceededPixel[0].x = 0;
+  exceededPixel[0].y = 0;
+
+  Frontier next = {nextFrontier, nextFrontierSize, stamps, round};
+
+  uint counters[STAT_COUNT];
+  for (int i = 0; i < STAT_COUNT; i++)
+    counters[i] = 0;
+
+  for (uint i = frontierBegin; i < frontierEnd; i++)
+    relaxGeodesic(obstacles, imageTable, costs, frontier[i], maxCost, exceededPixel, &next, counters);
 
   while(!empty(exceededPixel)) {
     uint4 p = pop(exceededPixel);
-    uint4 area = voronoi[p.z].nearestBackground;
-    Neighborhood neighborhood = getNeighborhood(image, imageAttrs, p);
-    for (int j = 0; j < neighborhood.size; j++) {
-      uint4 q = neighborhood.pixels[j];
-      uint4 curVRQ = voronoi[q.z].nearestBackground;
-      volatile __global uint4 *voronoiValuePtr = getVoronoiValuePtr(voronoi, voronoiSize, q);
-      do {
-        if (euclideanDistance(q, area) < euclideanDistance(q, curVRQ)) {
-          uint4 old = cmpxchg(voronoiValuePtr, curVRQ, area);
-          if (compareCoords(old, curVRQ)) {
-            push(exceededPixel, q);
-            break;
-          }
-        } else break;
-      } while (true);
+    relaxGeodesic(obstacles, imageTable, costs, p, maxCost, exceededPixel, &next, counters);
+  }
+
+#ifdef EDT_STATS
+  for (int i = 0; i < STAT_COUNT; i++)
+    if (counters[i] != 0)
+      atomic_add(&stats[i], counters[i]);
+#endif
+}
+
+/**
+ * \brief Coordenada inválida dos pixels invalidados no quadro atual, que
+ * precisam ser repropagados. A coordenada inválida comum marca os pixels que a
+ * propagação não alcança, sem fundo ou além da faixa.
+*/
+uint4 constructRaisedCoord() {
+  return (uint4)(UINT_MAX, 0, 0, 0);
+}
+
+bool isRaised(const uint4 coord) {
+  return coord.x == UINT_MAX && coord.y == 0;
+}
+
+/**
+ * \brief Primeiro passo de um quadro de vídeo, sobre o diagrama do quadro
+ * anterior mantido no dispositivo: um pixel que virou fundo passa a ser o seu
+ * próprio fundo mais próximo, e um pixel cujo fundo mais próximo deixou de ser
+ * fundo é invalidado. Os pixels invalidados no quadro anterior que continuaram
+ * sem fundo passam à coordenada inválida comum. Os demais continuam com o
+ * valor do quadro anterior.
+*/
+void __kernel updateSeeds(
+  __global const unsigned char *mask,
+  __global const unsigned char *previousMask,
+  const uint2 imageAttrs,
+  __global VoronoiDiagramMapEntry *voronoi
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  if (mask[i] == 0) {
+    if (previousMask[i] != 0)
+      voronoi[i].nearestBackground = constructCoord(i / imageAttrs.x, i % imageAttrs.x, imageAttrs.x);
+    return;
+  }
+  const uint4 nearest = voronoi[i].nearestBackground;
+  if (isRaised(nearest))
+    voronoi[i].nearestBackground = constructInvalidCoord();
+  else if (nearest.x != UINT_MAX && mask[nearest.z] != 0)
+    voronoi[i].nearestBackground = constructRaisedCoord();
+}
+
+/**
+ * \brief Segundo passo de um quadro de vídeo: coloca na fronteira os pixels de
+ * onde o quadro é repropagado. São os pixels válidos vizinhos de um invalidado
+ * neste quadro e os fundos novos com algum vizinho que não é fundo; os demais
+ * já estão corretos e não são visitados pela propagação. Os pixels que nunca
+ * foram alcançados, como os além da faixa, continuam fora do alcance sem um
+ * fundo novo.
+*/
+void __kernel collectFrontier(
+  __global const unsigned char *mask,
+  __global const unsigned char *previousMask,
+  const uint2 imageAttrs,
+  __global const VoronoiDiagramMapEntry *voronoi,
+  __global uint4 *frontier,
+  volatile __global uint *frontierSize
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y || voronoi[i].nearestBackground.x == UINT_MAX)
+    return;
+
+  uint4 p = constructCoord(i / imageAttrs.x, i % imageAttrs.x, imageAttrs.x);
+  const bool newSeed = mask[i] == 0 && previousMask[i] != 0;
+#pragma unroll
+  for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+    uint4 q;
+    if (!neighborCoord(p, imageAttrs, k, &q))
+      continue;
+    if (isRaised(voronoi[q.z].nearestBackground) || (newSeed && mask[q.z] != 0)) {
+      // O quadro é a única imagem da imageTable.
+      p.w = 0;
+      frontier[atomic_inc(frontierSize)] = p;
+      return;
+    }
+  }
+}
+
+/**
+ * \brief Distância de cada pixel ao seu fundo mais próximo, na mesma escala de
+ * computeDistances no host, saturada em maxDistance, que é também a distância
+ * dos pixels sem fundo.
+*/
+void __kernel distances(
+  __global const VoronoiDiagramMapEntry *voronoi,
+  const uint2 imageAttrs,
+  __global float *output,
+  const float maxDistance
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  const uint4 nearest = voronoi[i].nearestBackground;
+  const uint4 p = constructCoord(i / imageAttrs.x, i % imageAttrs.x, imageAttrs.x);
+  output[i] = nearest.x == UINT_MAX ? maxDistance : min(metricValue(metricDistance(p, nearest)), maxDistance);
+}
+
+/**
+ * \brief Complemento de uma máscara: o fundo vira objeto e o objeto, fundo. A
+ * dilatação é a erosão do complemento, com as sementes nos pixels de objeto.
+*/
+void __kernel invertMask(
+  __global const unsigned char *mask,
+  const uint2 imageAttrs,
+  __global unsigned char *output
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  output[i] = mask[i] == 0 ? 255 : 0;
+}
+
+/**
+ * \brief Limiar da erosão por um disco, sobre o diagrama propagado com a faixa
+ * igual ao raio: um pixel continua objeto só se nenhum fundo o alcançou, isto
+ * é, se o fundo mais próximo está além do raio. Com invert grava o
+ * complemento, que é a entrada invertida do passo seguinte da abertura e do
+ * fechamento.
+*/
+void __kernel erodeMask(
+  __global const VoronoiDiagramMapEntry *voronoi,
+  const uint2 imageAttrs,
+  const uint invert,
+  __global unsigned char *output
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  const bool object = voronoi[i].nearestBackground.x == UINT_MAX;
+  output[i] = object != (invert != 0) ? 255 : 0;
+}
+
+/**
+ * \brief Eixo medial pelo critério da transformada de eixo medial inteira: um
+ * pixel de objeto é do esqueleto quando o fundo mais próximo de algum vizinho
+ * de 4 está a mais de minFeatureDistance do seu, e a mediatriz dos dois fundos
+ * passa pelo menos tão perto dele quanto do vizinho, o que escolhe um só lado.
+ * Os pixels do esqueleto recebem a distância ao fundo e os demais, 0.
+*/
+void __kernel skeleton(
+  __global const unsigned char *mask,
+  __global const VoronoiDiagramMapEntry *voronoi,
+  const uint2 imageAttrs,
+  const float minFeatureDistance,
+  __global float *output
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  const uint4 fp = voronoi[i].nearestBackground;
+  output[i] = 0;
+  if (mask[i] == 0 || fp.x == UINT_MAX)
+    return;
+
+  const uint4 p = constructCoord(i / imageAttrs.x, i % imageAttrs.x, imageAttrs.x);
+  const int2 offsets[4] = {(int2)(1, 0), (int2)(-1, 0), (int2)(0, 1), (int2)(0, -1)};
+  for (int j = 0; j < 4; j++) {
+    const long qx = (long) p.x + offsets[j].x;
+    const long qy = (long) p.y + offsets[j].y;
+    if (qx < 0 || qy < 0 || qx >= imageAttrs.x || qy >= imageAttrs.y)
+      continue;
+    const uint4 fq = voronoi[qy * imageAttrs.x + qx].nearestBackground;
+    if (fq.x == UINT_MAX)
+      continue;
+
+    const long dx = (long) fp.x - fq.x;
+    const long dy = (long) fp.y - fq.y;
+    if ((float) (dx * dx + dy * dy) <= minFeatureDistance * minFeatureDistance)
+      continue;
+    // Sinal da diferença entre as distâncias do ponto médio de p e q aos dois
+    // fundos: não negativo quando a mediatriz fica do lado de p.
+    const long crit = dx * ((long) fp.x + fq.x - p.x - qx) +
+                      dy * ((long) fp.y + fq.y - p.y - qy);
+    if (crit >= 0) {
+      output[i] = metricValue(metricDistance(p, fp));
+      return;
     }
   }
-}
\ No newline at end of file
+}
+
+/**
+ * \brief Rótulo do pixel i numa imagem de rótulos com labelBytes bytes por
+ * pixel, 2 ou 4.
+*/
+uint readLabel(__global const uchar *labels, const uint labelBytes, const uint i) {
+  return labelBytes == 2 ? ((__global const ushort *) labels)[i]
+                         : ((__global const uint *) labels)[i];
+}
+
+/**
+ * \brief Máscara das sementes de uma imagem de rótulos: todo pixel com rótulo
+ * diferente de 0 é fundo, e os demais são objeto.
+*/
+void __kernel labelSeeds(
+  __global const uchar *labels,
+  const uint labelBytes,
+  const uint2 imageAttrs,
+  __global unsigned char *mask
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  mask[i] = readLabel(labels, labelBytes, i) != 0 ? 0 : 255;
+}
+
+/**
+ * \brief Rótulo da semente mais próxima de cada pixel, com o mesmo tamanho dos
+ * rótulos da entrada, e 0 onde nenhuma semente chegou.
+*/
+void __kernel nearestLabels(
+  __global const VoronoiDiagramMapEntry *voronoi,
+  __global const uchar *labels,
+  const uint labelBytes,
+  const uint2 imageAttrs,
+  __global uchar *output
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  const uint4 nearest = voronoi[i].nearestBackground;
+  const uint label = nearest.x == UINT_MAX ? 0 : readLabel(labels, labelBytes, nearest.z);
+  if (labelBytes == 2)
+    ((__global ushort *) output)[i] = label;
+  else
+    ((__global uint *) output)[i] = label;
+}
+
+/**
+ * \brief Semeia a transformada interior de cada instância de uma imagem de
+ * rótulos: grava em sameLabel a máscara dos vizinhos de cada pixel com o mesmo
+ * rótulo, usada pela propagação com -DINSTANCES, e coloca na fronteira os
+ * pixels com algum vizinho de outro rótulo, que são a borda dele. Os pixels de
+ * rótulo 0 são fundo, e os demais começam inválidos.
+*/
+void __kernel instanceSeeds(
+  __global const uchar *labels,
+  const uint labelBytes,
+  const uint2 imageAttrs,
+  __global unsigned char *sameLabel,
+  __global VoronoiDiagramMapEntry *voronoi,
+  __global uint4 *frontier,
+  volatile __global uint *frontierSize
+) {
+  const uint i = get_global_id(0);
+  if (i >= imageAttrs.x * imageAttrs.y)
+    return;
+
+  uint4 p = constructCoord(i / imageAttrs.x, i % imageAttrs.x, imageAttrs.x);
+  const uint label = readLabel(labels, labelBytes, i);
+  voronoi[i].nearestBackground = label == 0 ? p : constructInvalidCoord();
+
+  uchar mask = 0;
+  bool boundary = false;
+#pragma unroll
+  for (int k = 0; k < NEIGHBOR_COUNT; k++) {
+    uint4 q;
+    if (!neighborCoord(p, imageAttrs, k, &q))
+      continue;
+    if (readLabel(labels, labelBytes, q.z) == label)
+      mask |= 1 << k;
+    else
+      boundary = true;
+  }
+  sameLabel[i] = mask;
+  if (boundary) {
+    // A imagem é a única da imageTable.
+    p.w = 0;
+    frontier[atomic_inc(frontierSize)] = p;
+  }
+}